@@ -49,7 +49,7 @@ def check(proc, verbose):
         print(f"RUN {proc.args}:\n{proc.stdout}")
 
 
-def _attempt_configure(build_type, package):
+def _attempt_configure(build_type, package, count_allocations):
     if "PROCGEN_CMAKE_PREFIX_PATH" in os.environ:
         cmake_prefix_paths = [os.environ["PROCGEN_CMAKE_PREFIX_PATH"]]
     else:
@@ -82,6 +82,8 @@ def _attempt_configure(build_type, package):
     ]
     if package:
         configure_cmd.append("-DPROCGEN_PACKAGE=ON")
+    if count_allocations:
+        configure_cmd.append("-DPROCGEN_COUNT_ALLOCATIONS=ON")
     if platform.system() != "Windows":
         # this is not used on windows, the option needs to be passed to cmake --build instead
         configure_cmd.append(f"-DCMAKE_BUILD_TYPE={build_type}")
@@ -89,7 +91,7 @@ def _attempt_configure(build_type, package):
     check(run(configure_cmd), verbose=package)
 
 
-def build(package=False, debug=False):
+def build(package=False, debug=False, count_allocations=False):
     """
     Build the requested environment in a process-safe manner and only once per process.
     """
@@ -100,9 +102,14 @@ def build(package=False, debug=False):
     if debug:
         build_type = "debug"
 
+    # the allocation counting build goes in its own directory so it doesn't replace the normal one
+    build_name = build_type
+    if count_allocations:
+        build_name += "-count-allocations"
+
     with chdir(build_dir), global_build_lock:
         # check if we have built yet in this process
-        if build_type not in global_builds:
+        if build_name not in global_builds:
             if package:
                 # avoid the filelock dependency when building from setup.py
                 lock_ctx = nullcontext()
@@ -115,29 +122,29 @@ def build(package=False, debug=False):
                 sys.stdout.write("building procgen...")
                 sys.stdout.flush()
                 try:
-                    os.makedirs(build_type, exist_ok=True)
-                    with chdir(build_type):
-                        _attempt_configure(build_type, package)
+                    os.makedirs(build_name, exist_ok=True)
+                    with chdir(build_name):
+                        _attempt_configure(build_type, package, count_allocations)
                 except RunFailure:
                     # cmake can get into a weird state, so nuke the build directory and retry once
                     sys.stdout.write("retrying configure due to failure...")
                     sys.stdout.flush()
-                    shutil.rmtree(build_type)
-                    os.makedirs(build_type, exist_ok=True)
-                    with chdir(build_type):
-                        _attempt_configure(build_type, package)
+                    shutil.rmtree(build_name)
+                    os.makedirs(build_name, exist_ok=True)
+                    with chdir(build_name):
+                        _attempt_configure(build_type, package, count_allocations)
 
                 if "MAKEFLAGS" not in os.environ:
                     os.environ["MAKEFLAGS"] = f"-j{mp.cpu_count()}"
 
-                with chdir(build_type):
+                with chdir(build_name):
                     build_cmd = ["cmake", "--build", ".", "--config", build_type]
                     check(run(build_cmd), verbose=package)
                 print("done")
 
-            global_builds.add(build_type)
+            global_builds.add(build_name)
 
-    lib_dir = os.path.join(build_dir, build_type)
+    lib_dir = os.path.join(build_dir, build_name)
     if platform.system() == "Windows":
         # the built library is in a different location on windows
         lib_dir = os.path.join(lib_dir, build_type)
@@ -11,6 +11,11 @@ SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
 
 MAX_STATE_SIZE = 2 ** 20
 
+# file name of the environment library on linux, mac and windows
+LIB_NAMES = ["libenv.so", "libenv.dylib", "env.dll"]
+# built next to the environment library with count_allocations=True, see get_step_allocations()
+ALLOC_COUNTER_LIB_NAME = "libprocgen-alloc-counter.so"
+
 ENV_NAMES = [
     "bigfish",
     "bossfight",
@@ -51,6 +56,38 @@ DISTRIBUTION_MODE_DICT = {
     "exploration": 20,
 }
 
+# should match SteppingMode in vecgame.h
+STEPPING_MODE_DICT = {
+    "queue": 0,
+    "work_stealing": 1,
+    "chunked": 2,
+}
+
+# should match RenderBackend in renderer.h
+RENDER_BACKEND_DICT = {
+    "qt": 0,
+    "software": 1,
+}
+
+
+def is_prebuilt():
+    return os.path.exists(os.path.join(SCRIPT_DIR, "data", "prebuilt"))
+
+
+def get_lib_dir(debug=False, count_allocations=False):
+    """
+    Directory holding the environment library, which is built first when the package was not installed
+    with a pre-compiled library
+    """
+    if is_prebuilt():
+        lib_dir = os.path.join(SCRIPT_DIR, "data", "prebuilt")
+        assert any([os.path.exists(os.path.join(lib_dir, name)) for name in LIB_NAMES]), "package is installed, but the prebuilt environment library is missing"
+        assert not debug, "debug has no effect for pre-compiled library"
+        assert not count_allocations, "count_allocations has no effect for pre-compiled library"
+        return lib_dir
+    # only compile if we don't find a pre-built binary
+    return build(debug=debug, count_allocations=count_allocations)
+
 
 def create_random_seed():
     rand_seed = random.SystemRandom().randint(0, 2 ** 31 - 1)
@@ -75,27 +112,31 @@ class BaseProcgenEnv(CEnv):
         env_name,
         options,
         debug=False,
+        count_allocations=False,
         rand_seed=None,
         num_levels=0,
         start_level=0,
         use_sequential_levels=False,
         debug_mode=0,
         resource_root=None,
+        asset_pack=None,
+        shared_assets=False,
+        background_cache_mb=64,
         num_threads=4,
+        stepping_mode="queue",
+        chunk_size=0,
+        cpu_list=None,
+        shared_pool=False,
+        render_backend="qt",
         render_mode=None,
+        episode_stats=False,
     ):
         if resource_root is None:
             resource_root = os.path.join(SCRIPT_DIR, "data", "assets") + os.sep
             assert os.path.exists(resource_root)
 
-        lib_dir = os.path.join(SCRIPT_DIR, "data", "prebuilt")
-        if os.path.exists(lib_dir):
-            assert any([os.path.exists(os.path.join(lib_dir, name)) for name in ["libenv.so", "libenv.dylib", "env.dll"]]), "package is installed, but the prebuilt environment library is missing"
-            assert not debug, "debug has no effect for pre-compiled library"
-        else:
-            # only compile if we don't find a pre-built binary
-            lib_dir = build(debug=debug)
-        
+        lib_dir = get_lib_dir(debug=debug, count_allocations=count_allocations)
+
         self.combos = self.get_combos()
 
         if render_mode is None:
@@ -108,6 +149,14 @@ class BaseProcgenEnv(CEnv):
         if rand_seed is None:
             rand_seed = create_random_seed()
 
+        assert (
+            stepping_mode in STEPPING_MODE_DICT
+        ), f'"{stepping_mode}" is not a valid stepping mode.'
+
+        assert (
+            render_backend in RENDER_BACKEND_DICT
+        ), f'"{render_backend}" is not a valid render backend.'
+
         options.update(
             {
                 "env_name": env_name,
@@ -118,9 +167,18 @@ class BaseProcgenEnv(CEnv):
                 "debug_mode": debug_mode,
                 "rand_seed": rand_seed,
                 "num_threads": num_threads,
+                "stepping_mode": STEPPING_MODE_DICT[stepping_mode],
+                "chunk_size": chunk_size,
+                "cpu_list": cpu_list or "",
+                "shared_pool": bool(shared_pool),
+                "render_backend": RENDER_BACKEND_DICT[render_backend],
                 "render_human": render_human,
+                "episode_stats": bool(episode_stats),
                 # these will only be used the first time an environment is created in a process
                 "resource_root": resource_root,
+                "asset_pack": asset_pack or "",
+                "shared_assets": bool(shared_assets),
+                "background_cache_mb": background_cache_mb,
             }
         )
 
@@ -133,6 +191,11 @@ class BaseProcgenEnv(CEnv):
             c_func_defs=[
                 "int get_state(libenv_env *, int, char *, int);",
                 "void set_state(libenv_env *, int, char *, int);",
+                "int64_t get_entity_allocations(libenv_env *, int);",
+                "int64_t get_step_allocations(libenv_env *, int);",
+                "int get_buffer_set(libenv_env *);",
+                "void recv_ready(libenv_env *, int, int32_t *);",
+                "void send_ready(libenv_env *, int, int32_t *);",
             ],
         )
         # don't use the dict space for actions
@@ -153,6 +216,29 @@ class BaseProcgenEnv(CEnv):
             state = states[env_idx]
             self.call_c_func("set_state", env_idx, state, len(state))
 
+    def get_entity_allocations(self):
+        """
+        Number of entities each environment has allocated on the heap, erased entities are reused
+        so this should stop growing once a game has warmed up
+        """
+        return [
+            self.call_c_func("get_entity_allocations", env_idx)
+            for env_idx in range(self.num)
+        ]
+
+    def get_step_allocations(self):
+        """
+        Number of heap allocations made during the last step of each environment, only available when
+        the environment was created with count_allocations=True in a process started with
+        ALLOC_COUNTER_LIB_NAME from the library directory in LD_PRELOAD
+        """
+        result = [
+            self.call_c_func("get_step_allocations", env_idx)
+            for env_idx in range(self.num)
+        ]
+        assert all(n >= 0 for n in result), f"the library was not built with count_allocations=True or {ALLOC_COUNTER_LIB_NAME} was not preloaded"
+        return result
+
     def get_combos(self):
         return [
             ("LEFT", "DOWN"),
@@ -214,7 +300,10 @@ class ProcgenGym3Env(BaseProcgenEnv):
         use_monochrome_assets=False,
         restrict_themes=False,
         use_generated_assets=False,
+        generated_background_size=500,
         paint_vel_info=False,
+        cache_static_layer=True,
+        entity_hash_min_size=24,
         distribution_mode="hard",
         domain_config_path=None,
         **kwargs,
@@ -242,10 +331,13 @@ class ProcgenGym3Env(BaseProcgenEnv):
         options = {
                 "center_agent": bool(center_agent),
                 "use_generated_assets": bool(use_generated_assets),
+                "generated_background_size": generated_background_size,
                 "use_monochrome_assets": bool(use_monochrome_assets),
                 "restrict_themes": bool(restrict_themes),
                 "use_backgrounds": bool(use_backgrounds),
                 "paint_vel_info": bool(paint_vel_info),
+                "cache_static_layer": bool(cache_static_layer),
+                "entity_hash_min_size": entity_hash_min_size,
                 "distribution_mode": distribution_mode,
                 "domain_config_path": domain_config_path
             }
@@ -1,9 +1,112 @@
+import os
+import json
+import subprocess
+import sys
+import types
 import numpy as np
 import pytest
-from .env import ENV_NAMES
+from .env import ALLOC_COUNTER_LIB_NAME, ENV_NAMES, LIB_NAMES, get_lib_dir, is_prebuilt
 from procgen import ProcgenGym3Env
 
 
+class LibenvDriver:
+    """
+    Drives an environment through the libenv C interface directly, for the features that gym3's CEnv
+    doesn't use, such as registering two buffer sets
+    """
+
+    def __init__(self, num, env_name, **options):
+        self.num = num
+        # the gym3 environment provides the options and the cffi definitions of the libenv interface
+        self._gym3_env = ProcgenGym3Env(num=1, env_name=env_name)
+        self.ffi = self._gym3_env._ffi
+        lib_dir = get_lib_dir()
+        lib_path = [os.path.join(lib_dir, name) for name in LIB_NAMES if os.path.exists(os.path.join(lib_dir, name))][0]
+        self.lib = self.ffi.dlopen(lib_path)
+        self._keepalive = []
+
+        all_options = dict(self._gym3_env.options)
+        all_options.update(options)
+        self.c_env = self.lib.libenv_make(num, self._convert_options(all_options)[0])
+
+    def _convert_options(self, options):
+        items = self.ffi.new("struct libenv_option[]", len(options))
+        for item, (name, value) in zip(items, options.items()):
+            item.name = name.encode("utf8")
+            if isinstance(value, bool):
+                data = self.ffi.new("uint8_t[]", [value])
+                item.dtype = self.lib.LIBENV_DTYPE_UINT8
+                item.count = 1
+            elif isinstance(value, int):
+                data = self.ffi.new("int32_t[]", [value])
+                item.dtype = self.lib.LIBENV_DTYPE_INT32
+                item.count = 1
+            else:
+                encoded = value.encode("utf8")
+                data = self.ffi.new("char[]", encoded)
+                item.dtype = self.lib.LIBENV_DTYPE_UINT8
+                item.count = len(encoded)
+            item.data = data
+            self._keepalive.append(data)
+        c_options = self.ffi.new("struct libenv_options *")
+        c_options.items = items
+        c_options.count = len(options)
+        self._keepalive.append(items)
+        return c_options
+
+    def _get_types(self, space):
+        count = self.lib.libenv_get_tensortypes(self.c_env, space, self.ffi.NULL)
+        c_types = self.ffi.new("struct libenv_tensortype[]", count)
+        self.lib.libenv_get_tensortypes(self.c_env, space, c_types)
+        dtypes = {
+            self.lib.LIBENV_DTYPE_UINT8: np.uint8,
+            self.lib.LIBENV_DTYPE_INT32: np.int32,
+            self.lib.LIBENV_DTYPE_FLOAT32: np.float32,
+        }
+        return [
+            (self.ffi.string(t.name).decode("utf8"), tuple(t.shape[i] for i in range(t.ndim)), dtypes[t.dtype])
+            for t in c_types
+        ]
+
+    def add_buffer_set(self):
+        """
+        Allocate and register a buffer set, returns its arrays
+        """
+        c_bufs = self.ffi.new("struct libenv_buffers *")
+        bufs = types.SimpleNamespace()
+        for field, space in [("ob", self.lib.LIBENV_SPACE_OBSERVATION), ("ac", self.lib.LIBENV_SPACE_ACTION), ("info", self.lib.LIBENV_SPACE_INFO)]:
+            arrays = {}
+            space_types = self._get_types(space)
+            ptrs = self.ffi.new("void *[]", max(len(space_types), 1) * self.num)
+            for i, (name, shape, dtype) in enumerate(space_types):
+                arr = np.zeros((self.num,) + shape, dtype=dtype)
+                for e in range(self.num):
+                    ptrs[i * self.num + e] = self.ffi.cast("void *", arr.ctypes.data + e * arr.strides[0])
+                arrays[name] = arr
+            setattr(c_bufs, field, ptrs)
+            setattr(bufs, field, arrays)
+            self._keepalive.append(ptrs)
+        bufs.rew = np.zeros(self.num, dtype=np.float32)
+        bufs.first = np.zeros(self.num, dtype=np.uint8)
+        c_bufs.rew = self.ffi.cast("float *", bufs.rew.ctypes.data)
+        c_bufs.first = self.ffi.cast("uint8_t *", bufs.first.ctypes.data)
+        self._keepalive.append((c_bufs, bufs))
+        self.lib.libenv_set_buffers(self.c_env, c_bufs)
+        return bufs
+
+    def call(self, name, *args):
+        return getattr(self.lib, name)(self.c_env, *args)
+
+    def act(self):
+        self.lib.libenv_act(self.c_env)
+
+    def observe(self):
+        self.lib.libenv_observe(self.c_env)
+
+    def close(self):
+        self.lib.libenv_close(self.c_env)
+
+
 @pytest.mark.parametrize("env_name", ["coinrun", "starpilot"])
 def test_seeding(env_name):
     num_envs = 1
@@ -52,6 +155,529 @@ def test_determinism(env_name):
     assert np.array_equal(obs1, obs2)
 
 
+@pytest.mark.parametrize(
+    "stepping_kwargs",
+    [
+        dict(stepping_mode="work_stealing"),
+        dict(stepping_mode="chunked"),
+        dict(stepping_mode="chunked", chunk_size=3),
+        dict(shared_pool=True),
+    ],
+)
+@pytest.mark.parametrize("env_name", ["coinrun", "starpilot"])
+def test_stepping_mode(env_name, stepping_kwargs):
+    def collect_observations(**kwargs):
+        rng = np.random.RandomState(0)
+        env = ProcgenGym3Env(num=7, env_name=env_name, rand_seed=23, num_threads=3, **kwargs)
+        _, obs, _ = env.observe()
+        obses = [obs["rgb"]]
+        for _ in range(128):
+            env.act(
+                rng.randint(
+                    low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32
+                )
+            )
+            _, obs, _ = env.observe()
+            obses.append(obs["rgb"])
+        return np.array(obses)
+
+    expected = collect_observations(stepping_mode="queue")
+    actual = collect_observations(**stepping_kwargs)
+    assert np.array_equal(expected, actual)
+
+
+@pytest.mark.parametrize("env_name", ["coinrun", "starpilot"])
+def test_double_buffered(env_name):
+    num_envs = 4
+    rng = np.random.RandomState(0)
+    single = LibenvDriver(num_envs, env_name, rand_seed=23)
+    single_bufs = single.add_buffer_set()
+    double = LibenvDriver(num_envs, env_name, rand_seed=23, double_buffered=True)
+    buffer_sets = [double.add_buffer_set(), double.add_buffer_set()]
+    single.observe()
+    double.observe()
+
+    def assert_same(bufs, expected):
+        assert np.array_equal(bufs.ob["rgb"], expected.ob["rgb"])
+        assert np.array_equal(bufs.rew, expected.rew)
+        assert np.array_equal(bufs.first, expected.first)
+
+    assert double.call("get_buffer_set") == 0
+    assert_same(buffer_sets[0], single_bufs)
+
+    for _ in range(256):
+        prev_set = double.call("get_buffer_set")
+        prev_bufs = buffer_sets[prev_set]
+        prev_rgb = single_bufs.ob["rgb"].copy()
+
+        actions = rng.randint(low=0, high=15, size=(num_envs,), dtype=np.int32)
+        single_bufs.ac["action"][:] = actions
+        prev_bufs.ac["action"][:] = actions
+        single.act()
+        double.act()
+        # the set the games are writing to is only reported once observe() has waited for them
+        assert double.call("get_buffer_set") == prev_set
+        single.observe()
+        double.observe()
+
+        bufs = buffer_sets[double.call("get_buffer_set")]
+        assert bufs is not prev_bufs
+        assert_same(bufs, single_bufs)
+        # the observation the actions were chosen from is left in place while the games step
+        assert np.array_equal(prev_bufs.ob["rgb"], prev_rgb)
+
+    single.close()
+    double.close()
+
+
+@pytest.mark.parametrize("env_name", ["coinrun", "starpilot"])
+def test_ready_set(env_name):
+    num_envs = 8
+    num_steps = 64
+    rng = np.random.RandomState(0)
+    actions = rng.randint(low=0, high=15, size=(num_envs, num_steps), dtype=np.int32)
+
+    def record(trajectories, bufs, env_idx):
+        trajectories[env_idx].append((bufs.ob["rgb"][env_idx].copy(), bufs.rew[env_idx], bufs.first[env_idx]))
+
+    full = LibenvDriver(num_envs, env_name, rand_seed=23)
+    full_bufs = full.add_buffer_set()
+    full.observe()
+    expected = [[] for _ in range(num_envs)]
+    for e in range(num_envs):
+        record(expected, full_bufs, e)
+    for t in range(num_steps):
+        full_bufs.ac["action"][:] = actions[:, t]
+        full.act()
+        full.observe()
+        for e in range(num_envs):
+            record(expected, full_bufs, e)
+    full.close()
+
+    partial = LibenvDriver(num_envs, env_name, rand_seed=23)
+    bufs = partial.add_buffer_set()
+    env_idxs = partial.ffi.new("int32_t[]", num_envs)
+    actual = [[] for _ in range(num_envs)]
+    # every environment is ready once it has rendered its first observation
+    partial.call("recv_ready", num_envs, env_idxs)
+    assert sorted(env_idxs) == list(range(num_envs))
+    for e in range(num_envs):
+        record(actual, bufs, e)
+
+    steps = np.zeros(num_envs, dtype=np.int32)
+    while np.any(steps < num_steps):
+        idle = np.flatnonzero(steps < num_steps)
+        sent = [int(e) for e in rng.choice(idle, size=rng.randint(1, len(idle) + 1), replace=False)]
+        for e in sent:
+            bufs.ac["action"][e] = actions[e, steps[e]]
+            steps[e] += 1
+        partial.call("send_ready", len(sent), partial.ffi.new("int32_t[]", sent))
+
+        # collect the stepped environments over several calls
+        received = []
+        while len(received) < len(sent):
+            count = rng.randint(1, len(sent) - len(received) + 1)
+            partial.call("recv_ready", count, env_idxs)
+            received.extend(env_idxs[i] for i in range(count))
+        assert sorted(received) == sorted(sent)
+        for e in received:
+            record(actual, bufs, e)
+    partial.close()
+
+    for e in range(num_envs):
+        assert len(actual[e]) == len(expected[e])
+        for (obs, rew, first), (expected_obs, expected_rew, expected_first) in zip(actual[e], expected[e]):
+            assert np.array_equal(obs, expected_obs)
+            assert rew == expected_rew
+            assert first == expected_first
+
+
+READY_SET_SCRIPT = """
+import sys
+from procgen import ProcgenGym3Env
+
+stepping_mode, func_name = sys.argv[1], sys.argv[2]
+env = ProcgenGym3Env(num=2, env_name="coinrun", stepping_mode=stepping_mode)
+env.call_c_func(func_name, 1, env._ffi.new("int32_t[]", [0]))
+"""
+
+
+@pytest.mark.parametrize("stepping_mode", ["work_stealing", "chunked"])
+@pytest.mark.parametrize("func_name", ["recv_ready", "send_ready"])
+def test_ready_set_requires_queue_stepping(stepping_mode, func_name):
+    proc = subprocess.run([sys.executable, "-c", READY_SET_SCRIPT, stepping_mode, func_name], stdout=subprocess.PIPE, stderr=subprocess.STDOUT, encoding="utf8")
+    assert proc.returncode != 0
+    assert "only supported with stepping_mode=queue" in proc.stdout
+
+
+@pytest.mark.parametrize("env_name", ENV_NAMES)
+@pytest.mark.parametrize("use_generated_assets", [False, True])
+@pytest.mark.parametrize("rand_seed", [5, 23])
+def test_render_backend(env_name, use_generated_assets, rand_seed):
+    def collect_observations(render_backend):
+        rng = np.random.RandomState(0)
+        env = ProcgenGym3Env(num=4, env_name=env_name, rand_seed=rand_seed, render_backend=render_backend, use_generated_assets=use_generated_assets)
+        _, obs, _ = env.observe()
+        obses = [obs["rgb"]]
+        for _ in range(128):
+            env.act(
+                rng.randint(
+                    low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32
+                )
+            )
+            _, obs, _ = env.observe()
+            obses.append(obs["rgb"])
+        return np.array(obses)
+
+    expected = collect_observations("qt")
+    actual = collect_observations("software")
+    assert np.array_equal(expected, actual)
+
+
+ASSET_BACKEND_SCRIPT = """
+import sys
+import hashlib
+import json
+import numpy as np
+from procgen import ProcgenGym3Env
+
+env_name, render_backend, out_path = sys.argv[1], sys.argv[2], sys.argv[3]
+digests = []
+for rand_seed in range(3):
+    rng = np.random.RandomState(rand_seed)
+    env = ProcgenGym3Env(num=2, env_name=env_name, rand_seed=rand_seed, use_generated_assets=True, render_backend=render_backend, render_mode="rgb_array")
+    for step in range(60):
+        actions = rng.randint(low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32)
+        # start new levels now and then, so that more backgrounds are generated
+        if step % 15 == 14:
+            actions[:] = -1
+        env.act(actions)
+        digests.append([hashlib.sha1(info["rgb"].tobytes()).hexdigest() for info in env.get_info()])
+with open(out_path, "w") as f:
+    json.dump(digests, f)
+"""
+
+
+@pytest.mark.parametrize("env_name", ENV_NAMES)
+def test_generated_assets_backend(tmp_path, env_name):
+    # rgb_array frames are drawn with qt on either backend, so they only match if the generated
+    # assets and backgrounds do, each backend runs in its own process so they can't share any
+    def collect_digests(render_backend):
+        out_path = str(tmp_path / f"{render_backend}.json")
+        subprocess.run([sys.executable, "-c", ASSET_BACKEND_SCRIPT, env_name, render_backend, out_path], check=True)
+        with open(out_path) as f:
+            return json.load(f)
+
+    assert collect_digests("software") == collect_digests("qt")
+
+
+def collect_static_layer_frames(cache_static_layer, **kwargs):
+    rng = np.random.RandomState(0)
+    env = ProcgenGym3Env(num=2, rand_seed=23, render_mode="rgb_array", cache_static_layer=cache_static_layer, **kwargs)
+    frames = []
+
+    def record():
+        rew, obs, first = env.observe()
+        frames.append((obs["rgb"].copy(), np.array([info["rgb"] for info in env.get_info()]), rew.copy(), first.copy()))
+
+    record()
+    states = None
+    for step in range(300):
+        # going back to an earlier state must not keep the layer drawn for the later one
+        if step % 50 == 10:
+            states = env.get_state()
+        elif step % 50 == 40:
+            env.set_state(states)
+            record()
+        env.act(
+            rng.randint(
+                low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32
+            )
+        )
+        record()
+    return frames
+
+
+def assert_same_static_layer_frames(**kwargs):
+    expected = collect_static_layer_frames(cache_static_layer=False, **kwargs)
+    actual = collect_static_layer_frames(cache_static_layer=True, **kwargs)
+    assert len(actual) == len(expected)
+    for frame, expected_frame in zip(actual, expected):
+        for a, e in zip(frame, expected_frame):
+            assert np.array_equal(a, e)
+
+
+# miner has no static layer, but changes more cells per step than any other game
+@pytest.mark.parametrize("env_name", ["caveflyer", "chaser", "heist", "jumper", "maze", "plunder", "miner"])
+@pytest.mark.parametrize("render_backend", ["qt", "software"])
+# without center_agent the view doesn't move, so the layer is kept for a whole level and changed
+# cells are redrawn into it
+@pytest.mark.parametrize("center_agent", [True, False])
+def test_static_layer(env_name, render_backend, center_agent):
+    assert_same_static_layer_frames(env_name=env_name, render_backend=render_backend, center_agent=center_agent)
+
+
+# only memory mode centers the view on the agent in these, maze keeps the layer while its agent
+# stays in one cell and heist draws every frame from scratch
+@pytest.mark.parametrize("env_name", ["heist", "maze"])
+def test_static_layer_memory_mode(env_name):
+    assert_same_static_layer_frames(env_name=env_name, distribution_mode="memory")
+
+
+@pytest.mark.parametrize("env_name", ENV_NAMES)
+def test_entity_hash(env_name):
+    # 0 finds colliding entities through the hash at any size and -1 checks every pair
+    def collect_steps(entity_hash_min_size):
+        rng = np.random.RandomState(0)
+        env = ProcgenGym3Env(num=4, env_name=env_name, rand_seed=23, entity_hash_min_size=entity_hash_min_size)
+        steps = []
+        for _ in range(500):
+            env.act(
+                rng.randint(
+                    low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32
+                )
+            )
+            rew, obs, first = env.observe()
+            steps.append((obs["rgb"].copy(), rew.copy(), first.copy()))
+        return steps
+
+    expected = collect_steps(entity_hash_min_size=-1)
+    actual = collect_steps(entity_hash_min_size=0)
+    assert len(actual) == len(expected)
+    for step, expected_step in zip(actual, expected):
+        for a, e in zip(step, expected_step):
+            assert np.array_equal(a, e)
+
+
+@pytest.mark.parametrize("env_name", ["coinrun", "starpilot"])
+def test_episode_stats(env_name):
+    rng = np.random.RandomState(0)
+    env = ProcgenGym3Env(num=4, env_name=env_name, rand_seed=23, episode_stats=True)
+    returns = np.zeros(env.num, dtype=np.float32)
+    lengths = np.zeros(env.num, dtype=np.int32)
+    completed = np.zeros(env.num, dtype=np.int32)
+    solved = np.zeros(env.num, dtype=np.int32)
+
+    for _ in range(1000):
+        env.act(
+            rng.randint(
+                low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32
+            )
+        )
+        rew, _, first = env.observe()
+        returns += rew
+        lengths += 1
+        completed += first
+        for i, info in enumerate(env.get_info()):
+            solved[i] += info["prev_level_complete"]
+            assert np.isclose(info["episode_return"], returns[i])
+            assert info["episode_length"] == lengths[i]
+            assert info["episodes_completed"] == completed[i]
+            assert info["levels_solved"] == solved[i]
+        returns[first] = 0
+        lengths[first] = 0
+
+
+@pytest.mark.parametrize("env_name", ["starpilot", "bossfight", "dodgeball"])
+def test_entity_pool(env_name):
+    rng = np.random.RandomState(0)
+    env = ProcgenGym3Env(num=2, env_name=env_name, num_levels=1, rand_seed=23)
+
+    def run(num_steps):
+        for _ in range(num_steps):
+            env.act(
+                rng.randint(
+                    low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32
+                )
+            )
+            env.observe()
+        return np.array(env.get_entity_allocations())
+
+    warm = run(1000)
+    # after warming up, nearly every entity a game spawns is one it erased earlier, so the pool only
+    # grows when more entities than ever before are alive at once
+    later = run(2000) - warm
+    assert np.all(warm > 0)
+    assert np.all(later * 10 <= warm)
+
+
+STEP_ALLOCATIONS_SCRIPT = """
+import sys
+import json
+import numpy as np
+from procgen import ProcgenGym3Env
+
+env_name, out_path = sys.argv[1], sys.argv[2]
+rng = np.random.RandomState(0)
+env = ProcgenGym3Env(num=1, env_name=env_name, num_levels=1, rand_seed=23, render_backend="software", count_allocations=True)
+steps = []
+entity_allocations = env.get_entity_allocations()[0]
+for _ in range(1500):
+    env.act(
+        rng.randint(
+            low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32
+        )
+    )
+    _, _, first = env.observe()
+    new_entities = env.get_entity_allocations()[0] - entity_allocations
+    entity_allocations += new_entities
+    steps.append((bool(first[0]), env.get_step_allocations()[0], new_entities))
+with open(out_path, "w") as f:
+    json.dump(steps, f)
+"""
+
+
+@pytest.mark.skipif(not sys.platform.startswith("linux"), reason="count_allocations is only supported on linux")
+@pytest.mark.skipif(is_prebuilt(), reason="count_allocations needs the library built from source")
+@pytest.mark.parametrize("env_name", ENV_NAMES)
+def test_step_allocations(tmp_path, env_name):
+    # every malloc is counted, including Qt's, so the observations are drawn with the software
+    # renderer, and the counting library has to be preloaded, so the steps run in their own process
+    lib_dir = get_lib_dir(count_allocations=True)
+    counter_path = os.path.join(lib_dir, ALLOC_COUNTER_LIB_NAME)
+    if not os.path.exists(counter_path):
+        pytest.skip(f"{ALLOC_COUNTER_LIB_NAME} was not built in {lib_dir}, so allocations can't be counted")
+    process_env = dict(os.environ, LD_PRELOAD=counter_path)
+    out_path = str(tmp_path / "steps.json")
+    subprocess.run([sys.executable, "-c", STEP_ALLOCATIONS_SCRIPT, env_name, out_path], check=True, env=process_env)
+    with open(out_path) as f:
+        steps = json.load(f)
+
+    # the first steps fill the entity pool and grow the scratch buffers
+    for first, allocations, new_entities in steps[1000:]:
+        # a new level is generated during the step that ends an episode, and the entity pool still
+        # allocates one entity at a time when more are alive than ever before
+        if not first:
+            assert allocations == new_entities
+
+
+ASSETS_SCRIPT = """
+import sys
+import json
+import numpy as np
+from procgen import ProcgenGym3Env
+
+kwargs, out_path = json.loads(sys.argv[1]), sys.argv[2]
+env = ProcgenGym3Env(num=2, env_name="coinrun", rand_seed=23, **kwargs)
+obses = []
+for _ in range(32):
+    env.act(np.ones(env.num, dtype=np.int32))
+    _, obs, _ = env.observe()
+    obses.append(obs["rgb"])
+np.save(out_path, np.array(obses))
+"""
+
+
+def collect_asset_observations(tmp_path, process_env=None, **kwargs):
+    # the assets are only loaded by the first environment in a process, so each run needs its own
+    out_path = str(tmp_path / "obs.npy")
+    subprocess.run([sys.executable, "-c", ASSETS_SCRIPT, json.dumps(kwargs), out_path], check=True, env=process_env)
+    return np.load(out_path)
+
+
+@pytest.mark.skipif(sys.platform.startswith("win"), reason="asset_pack is not supported on windows")
+def test_asset_pack(tmp_path):
+    asset_pack = str(tmp_path / "assets.pack")
+
+    expected = collect_asset_observations(tmp_path)
+    # the first run decodes the images and writes the pack, the second one maps it
+    assert np.array_equal(collect_asset_observations(tmp_path, asset_pack=asset_pack), expected)
+    assert os.path.exists(asset_pack)
+    assert np.array_equal(collect_asset_observations(tmp_path, asset_pack=asset_pack), expected)
+
+
+SHARED_ASSETS_HOLDER_SCRIPT = """
+import sys
+from procgen import ProcgenGym3Env
+
+env = ProcgenGym3Env(num=1, env_name="coinrun", shared_assets=True)
+print("ready", flush=True)
+sys.stdin.read()
+"""
+
+
+@pytest.mark.skipif(not sys.platform.startswith("linux"), reason="shared_assets is only supported on linux")
+def test_shared_assets(tmp_path):
+    runtime_dir = tmp_path / "runtime"
+    runtime_dir.mkdir()
+    process_env = dict(os.environ, XDG_RUNTIME_DIR=str(runtime_dir))
+
+    def list_packs():
+        return [name for name in os.listdir(runtime_dir) if name.startswith("procgen-assets-")]
+
+    expected = collect_asset_observations(tmp_path)
+
+    # keep the pack in use while the other processes map it
+    holder = subprocess.Popen([sys.executable, "-c", SHARED_ASSETS_HOLDER_SCRIPT], stdin=subprocess.PIPE, stdout=subprocess.PIPE, env=process_env, encoding="utf8")
+    # a library built from source prints its build progress first
+    assert "ready" in (line.strip() for line in iter(holder.stdout.readline, ""))
+    assert len(list_packs()) > 0
+    assert np.array_equal(collect_asset_observations(tmp_path, process_env=process_env, shared_assets=True), expected)
+    assert np.array_equal(collect_asset_observations(tmp_path, process_env=process_env, shared_assets=True), expected)
+    assert len(list_packs()) > 0
+
+    # the last process using the pack removes it
+    holder.stdin.close()
+    assert holder.wait() == 0
+    assert list_packs() == []
+
+
+BACKGROUND_CACHE_SCRIPT = """
+import sys
+import json
+import numpy as np
+from procgen import ProcgenGym3Env
+
+kwargs, out_path = json.loads(sys.argv[1]), sys.argv[2]
+rng = np.random.RandomState(0)
+env = ProcgenGym3Env(num=4, rand_seed=23, num_levels=3, use_generated_assets=True, **kwargs)
+obses, rews, firsts = [], [], []
+for step in range(300):
+    actions = rng.randint(low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32)
+    # end the episode every so often, so the few levels come up again and reuse their backgrounds
+    if step % 20 == 19:
+        actions[:] = -1
+    env.act(actions)
+    rew, obs, first = env.observe()
+    obses.append(obs["rgb"])
+    rews.append(rew)
+    firsts.append(first)
+np.savez(out_path, obs=np.array(obses), rew=np.array(rews), first=np.array(firsts))
+"""
+
+
+@pytest.mark.parametrize("env_name", ENV_NAMES)
+@pytest.mark.parametrize("render_backend", ["qt", "software"])
+@pytest.mark.parametrize("generated_background_size", [500, 64])
+def test_background_cache(tmp_path, env_name, render_backend, generated_background_size):
+    def collect(background_cache_mb):
+        # the cache is only configured by the first environment in a process, so each run needs its own
+        out_path = str(tmp_path / "result.npz")
+        kwargs = dict(env_name=env_name, render_backend=render_backend, generated_background_size=generated_background_size, background_cache_mb=background_cache_mb)
+        subprocess.run([sys.executable, "-c", BACKGROUND_CACHE_SCRIPT, json.dumps(kwargs), out_path], check=True)
+        with np.load(out_path) as result:
+            return {key: result[key] for key in result.files}
+
+    expected = collect(background_cache_mb=0)
+    # a 1 MB cache holds at most one 500x500 background, so entries are evicted all the time
+    for background_cache_mb in [1, 64]:
+        actual = collect(background_cache_mb=background_cache_mb)
+        for key in expected:
+            assert np.array_equal(actual[key], expected[key])
+
+
+@pytest.mark.parametrize("env_name", ENV_NAMES)
+@pytest.mark.parametrize("render_backend", ["qt", "software"])
+def test_generated_assets_speed(env_name, render_backend, benchmark):
+    # every new environment generates its assets and its first background, and a random rand_seed
+    # keeps the background cache from helping
+    def create():
+        env = ProcgenGym3Env(num=16, env_name=env_name, use_generated_assets=True, render_backend=render_backend)
+        env.observe()
+
+    benchmark(create)
+
+
 @pytest.mark.parametrize("env_name", ENV_NAMES)
 @pytest.mark.parametrize("num_envs", [1, 2, 16])
 def test_multi_speed(env_name, num_envs, benchmark):
@@ -0,0 +1,87 @@
+/*
+
+Counts every call to malloc and the functions like it on each thread, including the ones made inside
+Qt and the C++ runtime
+
+This is built as its own library, libprocgen-alloc-counter.so, which has to be loaded before libc
+with LD_PRELOAD. The allocations themselves are handed to glibc's implementations. The env library
+finds procgen_thread_allocations() through a weak reference, see alloc-counter.cpp.
+
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+
+#define PRELOAD_API extern "C" __attribute__((visibility("default")))
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void *__libc_memalign(size_t align, size_t size);
+void *__libc_valloc(size_t size);
+void *__libc_pvalloc(size_t size);
+}
+
+// initial-exec so that reading it never has to allocate the thread's storage
+static thread_local int64_t allocations __attribute__((tls_model("initial-exec"))) = 0;
+
+PRELOAD_API int64_t procgen_thread_allocations() {
+    return allocations;
+}
+
+PRELOAD_API void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+PRELOAD_API void *calloc(size_t n, size_t size) {
+    allocations++;
+    return __libc_calloc(n, size);
+}
+
+PRELOAD_API void *realloc(void *p, size_t size) {
+    allocations++;
+    return __libc_realloc(p, size);
+}
+
+PRELOAD_API void *reallocarray(void *p, size_t n, size_t size) {
+    size_t total;
+    if (__builtin_mul_overflow(n, size, &total)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc(p, total);
+}
+
+PRELOAD_API void *memalign(size_t align, size_t size) {
+    allocations++;
+    return __libc_memalign(align, size);
+}
+
+PRELOAD_API void *aligned_alloc(size_t align, size_t size) {
+    return memalign(align, size);
+}
+
+PRELOAD_API int posix_memalign(void **out, size_t align, size_t size) {
+    if (align % sizeof(void *) != 0 || (align & (align - 1)) != 0) {
+        return EINVAL;
+    }
+    void *p = memalign(align, size);
+    if (p == nullptr) {
+        return ENOMEM;
+    }
+    *out = p;
+    return 0;
+}
+
+PRELOAD_API void *valloc(size_t size) {
+    allocations++;
+    return __libc_valloc(size);
+}
+
+PRELOAD_API void *pvalloc(size_t size) {
+    allocations++;
+    return __libc_pvalloc(size);
+}
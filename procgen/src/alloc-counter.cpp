@@ -0,0 +1,26 @@
+#include "alloc-counter.h"
+
+#ifdef PROCGEN_COUNT_ALLOCATIONS
+
+// defined by libprocgen-alloc-counter.so, null unless that was preloaded into the process
+extern "C" int64_t procgen_thread_allocations() __attribute__((weak));
+
+bool counting_allocations() {
+    return procgen_thread_allocations != nullptr;
+}
+
+int64_t thread_allocations() {
+    return counting_allocations() ? procgen_thread_allocations() : 0;
+}
+
+#else
+
+bool counting_allocations() {
+    return false;
+}
+
+int64_t thread_allocations() {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,16 @@
+#pragma once
+
+/*
+
+Counts the heap allocations made on each thread
+
+Only builds configured with PROCGEN_COUNT_ALLOCATIONS can count, and only in a process started with
+libprocgen-alloc-counter.so in LD_PRELOAD (see alloc-counter-preload.cpp), which counts every call to
+malloc, including the ones made inside Qt and the C++ runtime. Otherwise the count stays at 0.
+
+*/
+
+#include <cstdint>
+
+bool counting_allocations();
+int64_t thread_allocations();
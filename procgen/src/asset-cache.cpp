@@ -0,0 +1,55 @@
+#include "asset-cache.h"
+#include <mutex>
+#include <map>
+#include <tuple>
+#include <algorithm>
+
+static std::mutex asset_cache_mutex;
+static std::map<BasicAssetKey, std::weak_ptr<const BasicAsset>> entries;
+// expired entries are removed by a sweep once the map has doubled in size since the last one, so
+// with generated assets and unlimited seeds the map stays within twice the number of live assets
+static size_t sweep_size = 64;
+
+static void sweep_expired_entries() {
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->second.expired()) {
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    sweep_size = std::max(entries.size() * 2, (size_t)(64));
+}
+
+bool BasicAssetKey::operator<(const BasicAssetKey &other) const {
+    return std::tie(game_name, type, theme, generated, fixed_asset_seed) < std::tie(other.game_name, other.type, other.theme, other.generated, other.fixed_asset_seed);
+}
+
+std::shared_ptr<const BasicAsset> get_basic_asset(const BasicAssetKey &key, const std::function<std::shared_ptr<BasicAsset>()> &create) {
+    {
+        std::lock_guard<std::mutex> lock(asset_cache_mutex);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            auto asset = it->second.lock();
+            if (asset != nullptr) {
+                return asset;
+            }
+        }
+    }
+
+    // create outside the lock so that different assets are made in parallel, if two threads miss on
+    // the same asset the second one uses the first one's entry below
+    std::shared_ptr<const BasicAsset> created = create();
+
+    std::lock_guard<std::mutex> lock(asset_cache_mutex);
+    auto &entry = entries[key];
+    auto asset = entry.lock();
+    if (asset != nullptr) {
+        return asset;
+    }
+    entry = created;
+    if (entries.size() >= sweep_size) {
+        sweep_expired_entries();
+    }
+    return created;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+/*
+
+A process-wide cache of the images that BasicAbstractGame draws for each asset type and theme
+
+An asset only depends on the game, the type, the theme and, for generated assets, the asset seed, so
+all the environments of a game share one copy of it instead of each loading, generating and
+mirroring its own. Entries are reference counted, an entry is dropped once no environment holds it
+
+*/
+
+#include <QtGui/QImage>
+#include <memory>
+#include <string>
+#include <functional>
+#include "randgen.h"
+
+struct BasicAsset {
+    std::shared_ptr<QImage> image;
+    std::shared_ptr<QImage> reflection;
+    float aspect_ratio = 1.0f;
+    // the state of the asset rand gen after generating image, so that a game that finds a generated
+    // asset in the cache is left in the same state as one that generated it
+    RandGen rand_gen;
+};
+
+struct BasicAssetKey {
+    std::string game_name;
+    int type;
+    int theme;
+    bool generated;
+    int fixed_asset_seed;
+
+    bool operator<(const BasicAssetKey &other) const;
+};
+
+// the asset for key, calls create to make it if no environment holds it right now
+std::shared_ptr<const BasicAsset> get_basic_asset(const BasicAssetKey &key, const std::function<std::shared_ptr<BasicAsset>()> &create);
@@ -0,0 +1,315 @@
+#include "asset-pack.h"
+#include "cpp-utils.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <set>
+#include <sys/stat.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#define HAVE_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#endif
+
+// changes whenever the layout of the file changes
+static const char ASSET_PACK_MAGIC[8] = {'P', 'G', 'A', 'S', 'S', 'E', 'T', '1'};
+// the pixels of each image start on a cache line
+static const size_t ASSET_PACK_ALIGN = 64;
+
+// the file is a header, then num_entries entries, then the relpaths of the entries, then the pixels
+struct AssetPackHeader {
+    char magic[8];
+    uint32_t num_entries;
+    uint32_t strings_length;
+};
+
+struct AssetPackEntry {
+    uint64_t pixels_offset;
+    int64_t source_size;
+    int64_t source_mtime;
+    int32_t format;
+    int32_t width;
+    int32_t height;
+    int32_t bytes_per_line;
+    uint32_t relpath_offset;
+    uint32_t relpath_length;
+};
+
+#ifdef HAVE_MMAP
+static bool is_current_file(int fd, const std::string &path) {
+    struct stat opened, current;
+    return fstat(fd, &opened) == 0 && stat(path.c_str(), &current) == 0 && opened.st_dev == current.st_dev && opened.st_ino == current.st_ino;
+}
+
+// open path, creating it if needed, and flock it, a file that was removed while waiting for the lock
+// is opened again so that the lock is always on the file at path
+static int lock_file(const std::string &path, int operation) {
+    while (1) {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            return -1;
+        }
+        if (flock(fd, operation) != 0) {
+            close(fd);
+            return -1;
+        }
+        if (is_current_file(fd, path)) {
+            return fd;
+        }
+        close(fd);
+    }
+}
+#endif
+
+static size_t align_offset(size_t offset) {
+    return (offset + ASSET_PACK_ALIGN - 1) / ASSET_PACK_ALIGN * ASSET_PACK_ALIGN;
+}
+
+static bool stat_source(const std::string &path, int64_t *size, int64_t *mtime) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    *size = (int64_t)(st.st_size);
+    *mtime = (int64_t)(st.st_mtime);
+    return true;
+}
+
+bool AssetPack::open(const std::string &path) {
+#ifdef HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)(st.st_size) < sizeof(AssetPackHeader)) {
+        close(fd);
+        return false;
+    }
+
+    // the images point into the mapping, so it stays mapped for the rest of the process
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+
+    const uchar *mapped_data = (const uchar *)(mapped);
+    size_t mapped_length = st.st_size;
+
+    const AssetPackHeader *header = (const AssetPackHeader *)(mapped_data);
+    const AssetPackEntry *pack_entries = (const AssetPackEntry *)(mapped_data + sizeof(AssetPackHeader));
+    const char *strings = (const char *)(pack_entries + header->num_entries);
+    size_t index_length = sizeof(AssetPackHeader) + (size_t)(header->num_entries) * sizeof(AssetPackEntry) + header->strings_length;
+
+    bool valid = memcmp(header->magic, ASSET_PACK_MAGIC, sizeof(ASSET_PACK_MAGIC)) == 0 && index_length <= mapped_length;
+
+    std::map<std::pair<std::string, int>, size_t> pack_index;
+    for (uint32_t i = 0; valid && i < header->num_entries; i++) {
+        const AssetPackEntry &e = pack_entries[i];
+        uint64_t pixels_length = (uint64_t)(e.bytes_per_line) * (uint64_t)(e.height);
+        valid = (uint64_t)(e.relpath_offset) + e.relpath_length <= header->strings_length &&
+                e.pixels_offset % ASSET_PACK_ALIGN == 0 && e.pixels_offset >= index_length &&
+                e.width > 0 && e.height > 0 && e.bytes_per_line >= e.width * 4 &&
+                e.pixels_offset + pixels_length <= mapped_length;
+        if (!valid) {
+            break;
+        }
+        pack_index[std::make_pair(std::string(strings + e.relpath_offset, e.relpath_length), e.format)] = i;
+    }
+
+    if (!valid) {
+        munmap(mapped, mapped_length);
+        return false;
+    }
+
+    data = mapped_data;
+    length = mapped_length;
+    entries = pack_index;
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::shared_ptr<QImage> AssetPack::find(const std::string &resource_root, const std::string &relpath, QImage::Format format) const {
+    auto it = entries.find(std::make_pair(relpath, (int)(format)));
+    if (it == entries.end()) {
+        return nullptr;
+    }
+
+    const AssetPackEntry *pack_entries = (const AssetPackEntry *)(data + sizeof(AssetPackHeader));
+    const AssetPackEntry &e = pack_entries[it->second];
+
+    int64_t size, mtime;
+    if (!stat_source(resource_root + relpath, &size, &mtime) || size != e.source_size || mtime != e.source_mtime) {
+        return nullptr;
+    }
+
+    // an image over read-only memory makes a copy of its pixels if it is ever modified
+    return std::make_shared<QImage>(data + e.pixels_offset, e.width, e.height, e.bytes_per_line, format);
+}
+
+bool AssetPack::write(const std::string &path, const std::string &resource_root, const std::vector<AssetPackImage> &images) {
+#ifdef HAVE_MMAP
+    std::vector<AssetPackEntry> pack_entries;
+    std::vector<const QImage *> pack_images;
+    std::string strings;
+    std::set<std::pair<std::string, int>> added;
+
+    for (const auto &img : images) {
+        const QImage &image = *img.image;
+        auto key = std::make_pair(img.relpath, (int)(image.format()));
+        if (added.count(key) > 0) {
+            continue;
+        }
+        added.insert(key);
+
+        AssetPackEntry e;
+        memset(&e, 0, sizeof(e));
+        if (!stat_source(resource_root + img.relpath, &e.source_size, &e.source_mtime)) {
+            return false;
+        }
+        e.format = (int32_t)(image.format());
+        e.width = image.width();
+        e.height = image.height();
+        e.bytes_per_line = image.bytesPerLine();
+        e.relpath_offset = (uint32_t)(strings.size());
+        e.relpath_length = (uint32_t)(img.relpath.size());
+        strings += img.relpath;
+
+        pack_entries.push_back(e);
+        pack_images.push_back(&image);
+    }
+
+    size_t offset = align_offset(sizeof(AssetPackHeader) + pack_entries.size() * sizeof(AssetPackEntry) + strings.size());
+    for (auto &e : pack_entries) {
+        e.pixels_offset = offset;
+        offset = align_offset(offset + (size_t)(e.bytes_per_line) * e.height);
+    }
+
+    AssetPackHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ASSET_PACK_MAGIC, sizeof(ASSET_PACK_MAGIC));
+    header.num_entries = (uint32_t)(pack_entries.size());
+    header.strings_length = (uint32_t)(strings.size());
+
+    // write to a temporary file and rename it into place, so that other processes starting at the
+    // same time never map a partially written pack
+    std::string tmp_path = path + ".tmp" + std::to_string(getpid());
+    FILE *f = fopen(tmp_path.c_str(), "wb");
+    if (f == nullptr) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok && (pack_entries.empty() || fwrite(pack_entries.data(), sizeof(AssetPackEntry), pack_entries.size(), f) == pack_entries.size());
+    ok = ok && fwrite(strings.data(), 1, strings.size(), f) == strings.size();
+
+    std::vector<char> padding(ASSET_PACK_ALIGN, 0);
+    for (size_t i = 0; ok && i < pack_entries.size(); i++) {
+        long pos = ftell(f);
+        size_t pad = pack_entries[i].pixels_offset - (size_t)(pos);
+        ok = pos >= 0 && pad < ASSET_PACK_ALIGN && fwrite(padding.data(), 1, pad, f) == pad;
+        size_t pixels_length = (size_t)(pack_entries[i].bytes_per_line) * pack_entries[i].height;
+        ok = ok && fwrite(pack_images[i]->constBits(), 1, pixels_length, f) == pixels_length;
+    }
+
+    ok = fclose(f) == 0 && ok;
+    ok = ok && rename(tmp_path.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        remove(tmp_path.c_str());
+    }
+    return ok;
+#else
+    return false;
+#endif
+}
+
+AssetPackLock::AssetPackLock(const std::string &path) {
+#ifdef HAVE_MMAP
+    fd = lock_file(path + ".lock", LOCK_EX);
+#endif
+}
+
+AssetPackLock::~AssetPackLock() {
+#ifdef HAVE_MMAP
+    if (fd >= 0) {
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+#endif
+}
+
+// FNV-1a, std::hash may give a different value in another build, which would leave a pack behind
+// that no process uses
+static uint64_t fnv1a_hash(const std::string &s) {
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+std::string shared_asset_pack_path(const std::string &resource_root) {
+#ifdef __linux__
+    // shm_open() names are files in /dev/shm on linux, which also lets the pack be replaced by
+    // renaming a new one over it like any other pack, the format is part of the name so that a build
+    // with a different format doesn't replace the pack of processes still using it
+    std::string dir = "/dev/shm";
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir != nullptr && runtime_dir[0] != '\0') {
+        dir = runtime_dir;
+    }
+    uint64_t h = fnv1a_hash(std::string(ASSET_PACK_MAGIC, sizeof(ASSET_PACK_MAGIC)) + resource_root);
+    char name[64];
+    snprintf(name, sizeof(name), "procgen-assets-%u-%016llx", (unsigned)(getuid()), (unsigned long long)(h));
+    return dir + "/" + name;
+#else
+    fatal("shared_assets is only supported on linux\n");
+    return "";
+#endif
+}
+
+// every process using a shared pack holds a shared lock on path + ".users" until it exits, so the
+// process that can take an exclusive lock on it when exiting is the last one
+struct SharedPackUser {
+    std::string path;
+    int fd = -1;
+
+    ~SharedPackUser() {
+#ifdef HAVE_MMAP
+        if (fd < 0) {
+            return;
+        }
+        std::string users_path = path + ".users";
+        // a process that starts now waits for the exclusive lock and then opens the files again,
+        // processes only take the pack lock after their lock on the users file
+        flock(fd, LOCK_UN);
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0 && is_current_file(fd, users_path)) {
+            remove(path.c_str());
+            remove((path + ".lock").c_str());
+            remove(users_path.c_str());
+        }
+        close(fd);
+#endif
+    }
+};
+
+static SharedPackUser shared_pack_user;
+
+void use_shared_asset_pack(const std::string &path) {
+#ifdef HAVE_MMAP
+    fassert(shared_pack_user.fd < 0);
+    shared_pack_user.path = path;
+    shared_pack_user.fd = lock_file(path + ".users", LOCK_SH);
+    if (shared_pack_user.fd < 0) {
+        fatal("failed to lock %s.users\n", path.c_str());
+    }
+#endif
+}
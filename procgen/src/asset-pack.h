@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+
+A single file of assets that were already decoded and converted to the format they are used in
+
+The file starts with an index of the images, followed by their pixels, so it can be mapped into
+memory and each image used in place without copying. Every entry records the size and modification
+time of the image file it was decoded from, and entries whose file has changed since are ignored.
+
+*/
+
+#include <QtGui/QImage>
+#include <memory>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+struct AssetPackImage {
+    std::string relpath;
+    std::shared_ptr<QImage> image;
+};
+
+class AssetPack {
+  public:
+    // map the pack at path, returns false if there is no readable pack there
+    bool open(const std::string &path);
+
+    // the image decoded from resource_root + relpath in the given format, backed by the mapped
+    // file, or nullptr if the pack doesn't hold an up to date copy of it
+    std::shared_ptr<QImage> find(const std::string &resource_root, const std::string &relpath, QImage::Format format) const;
+
+    // write the images to a new pack at path, replacing any existing one, returns false on failure
+    static bool write(const std::string &path, const std::string &resource_root, const std::vector<AssetPackImage> &images);
+
+  private:
+    const uchar *data = nullptr;
+    size_t length = 0;
+    // index of each entry by relpath and format
+    std::map<std::pair<std::string, int>, size_t> entries;
+};
+
+// an exclusive lock on path + ".lock" that is held until it is destroyed, so processes that start at
+// the same time wait for the first one to write the pack instead of all decoding the images
+class AssetPackLock {
+  public:
+    AssetPackLock(const std::string &path);
+    ~AssetPackLock();
+
+  private:
+    int fd = -1;
+};
+
+// a pack in memory for the assets in resource_root, which every process of the current user with the
+// same resource_root maps, linux only, the pack is kept in $XDG_RUNTIME_DIR if it is set and in
+// /dev/shm otherwise, both of which are in memory
+std::string shared_asset_pack_path(const std::string &resource_root);
+
+// count this process as a user of the shared pack at path until it exits, the last user to exit
+// removes the pack so that it doesn't keep holding memory once no process needs it
+void use_shared_asset_pack(const std::string &path);
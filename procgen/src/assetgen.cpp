@@ -1,4 +1,5 @@
 #include "assetgen.h"
+#include "cpp-utils.h"
 
 struct ColorGen {
     RandGen *rand_gen;
@@ -28,8 +29,54 @@ struct ColorGen {
     }
 };
 
-AssetGen::AssetGen(RandGen *rg) {
+// the painter is only created if it is needed, so the software backend can generate an asset made of
+// opaque rects without setting one up
+class AssetCanvas {
+  public:
+    AssetCanvas(QImage *img, RenderBackend backend, bool source_mode)
+        : img(img), source_mode(source_mode) {
+        if (backend == SoftwareRenderBackend) {
+            fassert(img->bytesPerLine() == img->width() * 4);
+            renderer = std::make_unique<SoftwareRenderer>((uint32_t *)(img->bits()), img->width(), img->height());
+        }
+    }
+
+    void fill_rect(const QRectF &rect, const QColor &color) {
+        // in source mode an opaque color replaces the pixels just as it would when blended over them
+        if (renderer != nullptr && (!source_mode || color.alpha() == 255)) {
+            renderer->fill_rect(rect, color);
+        } else {
+            get_painter()->fillRect(rect, color);
+        }
+    }
+
+    void draw_ellipse(const QRectF &rect, const QColor &brush_color, const QColor &pen_color) {
+        QPainter *p = get_painter();
+        p->setBrush(QBrush(brush_color));
+        p->setPen(QPen(pen_color));
+        p->drawEllipse(rect);
+    }
+
+  private:
+    QImage *img;
+    bool source_mode;
+    std::unique_ptr<SoftwareRenderer> renderer;
+    std::unique_ptr<QPainter> painter;
+
+    QPainter *get_painter() {
+        if (painter == nullptr) {
+            painter = std::make_unique<QPainter>(img);
+            if (source_mode) {
+                painter->setCompositionMode(QPainter::CompositionMode_Source);
+            }
+        }
+        return painter.get();
+    }
+};
+
+AssetGen::AssetGen(RandGen *rg, RenderBackend _backend) {
     rand_gen = rg;
+    backend = _backend;
 }
 
 QRectF AssetGen::choose_sub_rect(QRectF rect, float min_dim, float max_dim) {
@@ -72,7 +119,7 @@ std::vector<QRectF> AssetGen::split_rect(QRectF rect, int num_splits, bool is_ho
     return split_rects;
 }
 
-void AssetGen::paint_shape(QPainter &p, QRectF main_rect, ColorGen *cgen) {
+void AssetGen::paint_shape(AssetCanvas &p, QRectF main_rect, ColorGen *cgen) {
     int k = rand_gen->randn(10);
     int num_splits = (k * k) / 50 + 1;
     std::vector<QRectF> split_rects = split_rect(main_rect, num_splits, rand_gen->randbool());
@@ -90,25 +137,21 @@ void AssetGen::paint_shape(QPainter &p, QRectF main_rect, ColorGen *cgen) {
         }
 
         if (use_rect) {
-            p.fillRect(rect, c1);
+            p.fill_rect(rect, c1);
         } else {
-            QBrush brush(c1);
-            QPen pen(c2);
-            p.setBrush(brush);
-            p.setPen(pen);
-            p.drawEllipse(rect);
+            p.draw_ellipse(rect, c1, c2);
         }
     }
 }
 
-void AssetGen::paint_rect_resource(QPainter &p, QRectF rect, int num_recurse, int blotch_scale) {
+void AssetGen::paint_rect_resource(AssetCanvas &p, QRectF rect, int num_recurse, int blotch_scale) {
     ColorGen cgen;
     cgen.rand_gen = rand_gen;
     cgen.roll();
 
     QColor bgcolor = cgen.rand_color();
 
-    p.fillRect(rect, bgcolor);
+    p.fill_rect(rect, bgcolor);
 
     float scale = .3 + .7 * rand_gen->rand01();
 
@@ -128,7 +171,7 @@ void AssetGen::paint_rect_resource(QPainter &p, QRectF rect, int num_recurse, in
     }
 
     bgcolor.setAlpha(200);
-    p.fillRect(rect, bgcolor);
+    p.fill_rect(rect, bgcolor);
 }
 
 QRectF AssetGen::create_bar(QRectF rect, bool is_horizontal) {
@@ -148,7 +191,7 @@ QRectF AssetGen::create_bar(QRectF rect, bool is_horizontal) {
     return crect;
 }
 
-void AssetGen::paint_shape_resource(QPainter &p, QRectF rect) {
+void AssetGen::paint_shape_resource(AssetCanvas &p, QRectF rect) {
     ColorGen cgen;
     cgen.rand_gen = rand_gen;
     cgen.roll();
@@ -157,10 +200,7 @@ void AssetGen::paint_shape_resource(QPainter &p, QRectF rect) {
     int nbar1 = rand_gen->randn(3) / 2 + 1;
     int nbar2 = rand_gen->randn(3) / 2 + 1;
 
-    p.save();
-
-    p.setCompositionMode(QPainter::CompositionMode_Source);
-    p.fillRect(rect, QColor(0, 0, 0, 0));
+    p.fill_rect(rect, QColor(0, 0, 0, 0));
 
     for (int i = 0; i < nbar1; i++) {
         QRectF c1 = create_bar(rect, horizontal_first);
@@ -179,12 +219,11 @@ void AssetGen::paint_shape_resource(QPainter &p, QRectF rect) {
 
         paint_shape(p, dst, &cgen);
     }
-
-    p.restore();
 }
 
 void AssetGen::generate_resource(std::shared_ptr<QImage> img, int num_recurse, int blotch_scale, bool is_rect) {
-    QPainter p(img.get());
+    // shape resources are drawn with the source composition mode, so their background stays transparent
+    AssetCanvas p(img.get(), backend, !is_rect);
     QRectF rect = QRectF(0, 0, img->width(), img->height());
 
     if (is_rect) {
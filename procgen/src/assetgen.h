@@ -7,6 +7,7 @@ Generate assets procedurally
 */
 
 #include "randgen.h"
+#include "renderer.h"
 #include <QColor>
 #include <QImage>
 #include <QRectF>
@@ -14,20 +15,24 @@ Generate assets procedurally
 #include <memory>
 
 struct ColorGen;
+class AssetCanvas;
 
 class AssetGen {
 
   public:
-    AssetGen(RandGen *rg);
+    // with the software backend rects are filled directly in the pixels of the image instead of with
+    // a QPainter, which gives the same image in a fraction of the time
+    AssetGen(RandGen *rg, RenderBackend backend = QtRenderBackend);
     void generate_resource(std::shared_ptr<QImage> img, int num_recurse = 1, int blotch_scale = 50, bool is_rect = true);
 
   private:
     RandGen *rand_gen;
+    RenderBackend backend;
 
     std::vector<QRectF> split_rect(QRectF rect, int num_splits, bool is_horizontal);
     QRectF choose_sub_rect(QRectF rect, float min_dim, float max_dim);
     QRectF create_bar(QRectF rect, bool is_horizontal);
-    void paint_shape(QPainter &p, QRectF rect, ColorGen *cgen);
-    void paint_rect_resource(QPainter &p, QRectF rect, int num_recurse, int blotch_scale);
-    void paint_shape_resource(QPainter &p, QRectF rect);
+    void paint_shape(AssetCanvas &p, QRectF rect, ColorGen *cgen);
+    void paint_rect_resource(AssetCanvas &p, QRectF rect, int num_recurse, int blotch_scale);
+    void paint_shape_resource(AssetCanvas &p, QRectF rect);
 };
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "background-cache.h"
+#include "assetgen.h"
+#include <mutex>
+#include <list>
+#include <map>
+#include <tuple>
+
+struct BackgroundKey {
+    uint64_t state_hash;
+    int w;
+    int h;
+
+    bool operator<(const BackgroundKey &other) const {
+        return std::tie(state_hash, w, h) < std::tie(other.state_hash, other.w, other.h);
+    }
+};
+
+struct BackgroundEntry {
+    BackgroundKey key;
+    // the rand gen before and after generating image
+    std::mt19937 state_before;
+    std::mt19937 state_after;
+    std::shared_ptr<QImage> image;
+};
+
+static std::mutex background_cache_mutex;
+// most recently used entries are at the front
+static std::list<BackgroundEntry> lru;
+static std::map<BackgroundKey, std::list<BackgroundEntry>::iterator> entries;
+static size_t cache_bytes = 0;
+static size_t max_cache_bytes = 64 * 1024 * 1024;
+
+static size_t entry_bytes(const BackgroundEntry &entry) {
+    return sizeof(BackgroundEntry) + entry.image->sizeInBytes();
+}
+
+static void evict(size_t limit) {
+    while (cache_bytes > limit && lru.size() > 0) {
+        auto &oldest = lru.back();
+        cache_bytes -= entry_bytes(oldest);
+        entries.erase(oldest.key);
+        lru.pop_back();
+    }
+}
+
+// the first outputs of a copy of the generator, equal states always have the same hash
+static uint64_t hash_state(const std::mt19937 &stdgen) {
+    std::mt19937 copy = stdgen;
+    uint64_t hi = copy();
+    uint64_t lo = copy();
+    return (hi << 32) | lo;
+}
+
+std::shared_ptr<QImage> get_generated_background(RandGen *rand_gen, int w, int h, RenderBackend backend) {
+    BackgroundKey key{hash_state(rand_gen->stdgen), w, h};
+
+    {
+        std::lock_guard<std::mutex> lock(background_cache_mutex);
+        auto it = entries.find(key);
+        if (it != entries.end() && it->second->state_before == rand_gen->stdgen) {
+            lru.splice(lru.begin(), lru, it->second);
+            rand_gen->stdgen = it->second->state_after;
+            return it->second->image;
+        }
+    }
+
+    BackgroundEntry entry{key, rand_gen->stdgen, std::mt19937(), std::make_shared<QImage>(w, h, QImage::Format_RGB32)};
+
+    // generate outside the lock, if two threads miss on the same background they both do the work
+    AssetGen bggen(rand_gen, backend);
+    bggen.generate_resource(entry.image);
+    entry.state_after = rand_gen->stdgen;
+
+    std::lock_guard<std::mutex> lock(background_cache_mutex);
+    if (max_cache_bytes == 0) {
+        return entry.image;
+    }
+
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        cache_bytes -= entry_bytes(*it->second);
+        lru.erase(it->second);
+    }
+
+    auto image = entry.image;
+    lru.push_front(std::move(entry));
+    entries[key] = lru.begin();
+    cache_bytes += entry_bytes(lru.front());
+    evict(max_cache_bytes);
+
+    return image;
+}
+
+void set_background_cache_limit(size_t bytes) {
+    std::lock_guard<std::mutex> lock(background_cache_mutex);
+    max_cache_bytes = bytes;
+    evict(max_cache_bytes);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+/*
+
+A process-wide cache of the backgrounds AssetGen generates when use_generated_assets is set
+
+A generated background only depends on the state of the rand gen it is generated from and on its
+size, so levels that come up again, which is most of them when num_levels is small, reuse the image
+from the last time instead of painting it again. Entries are keyed by the exact state of the rand
+gen, and the least recently used ones are dropped once the cache holds more than the limit
+
+*/
+
+#include <QtGui/QImage>
+#include <memory>
+#include "randgen.h"
+#include "renderer.h"
+
+// generate a w x h background from rand_gen, leaving rand_gen in the same state as generating it
+// would, the returned image must not be modified
+std::shared_ptr<QImage> get_generated_background(RandGen *rand_gen, int w, int h, RenderBackend backend);
+
+// the most bytes of backgrounds to keep, 0 disables the cache
+void set_background_cache_limit(size_t bytes);
@@ -1,6 +1,7 @@
 #include "basic-abstract-game.h"
 #include "resources.h"
 #include "assetgen.h"
+#include "background-cache.h"
 #include "qt-utils.h"
 
 const float MAXVTHETA = 15 * PI / 180;
@@ -54,25 +55,34 @@ BasicAbstractGame::~BasicAbstractGame() {
 void BasicAbstractGame::game_init() {
     if (!options.use_generated_assets) {
         load_background_images();
+        load_backgrounds(main_bg_images_ptr);
+
+        // decode every image this game may draw at once, rather than one at a time while stepping
+        std::vector<std::string> all_names;
+        for (int type = 0; type < USE_ASSET_THRESHOLD; type++) {
+            std::vector<std::string> names;
+            asset_for_type(type, names);
+            if (names.size() == 0) {
+                reserved_asset_for_type(type, names);
+            }
+            all_names.insert(all_names.end(), names.begin(), names.end());
+        }
+        load_assets(all_names);
     }
 
     if (main_bg_images_ptr == nullptr) {
         main_bg_images_ptr = new std::vector<std::shared_ptr<QImage>>();
         use_procgen_background = true;
-        auto main_bg_image = std::make_shared<QImage>(500, 500, QImage::Format_RGB32);
-        main_bg_images_ptr->push_back(main_bg_image);
+        // filled in from the background cache by game_reset
+        main_bg_images_ptr->push_back(nullptr);
     } else {
         use_procgen_background = false;
     }
 
     basic_assets.clear();
-    basic_reflections.clear();
-    asset_aspect_ratios.clear();
     asset_num_themes.clear();
 
     basic_assets.resize(USE_ASSET_THRESHOLD * MAX_IMAGE_THEMES, nullptr);
-    basic_reflections.resize(USE_ASSET_THRESHOLD * MAX_IMAGE_THEMES, nullptr);
-    asset_aspect_ratios.resize(USE_ASSET_THRESHOLD * MAX_IMAGE_THEMES, 0);
     asset_num_themes.resize(USE_ASSET_THRESHOLD, 0);
 }
 
@@ -85,9 +95,6 @@ void BasicAbstractGame::initialize_asset_if_necessary(int img_idx) {
 
     theme = mask_theme_if_necessary(theme, type);
 
-    std::shared_ptr<QImage> asset_ptr = nullptr;
-    float aspect_ratio;
-    int num_themes;
     std::vector<std::string> names;
 
     if (!options.use_generated_assets) {
@@ -98,28 +105,35 @@ void BasicAbstractGame::initialize_asset_if_necessary(int img_idx) {
         }
     }
 
-    if (names.size() == 0) {
-        AssetGen pgen(&asset_rand_gen);
-        asset_rand_gen.seed(fixed_asset_seed + type);
+    bool generated = names.size() == 0;
 
-        std::shared_ptr<QImage> small_image(new QImage(64, 64, QImage::Format_ARGB32));
-        asset_ptr = small_image;
-        pgen.generate_resource(asset_ptr, 0, 5, use_block_asset(type));
+    // generated assets are the same for every theme, and loaded ones don't depend on the seed
+    BasicAssetKey key{game_name, type, generated ? 0 : theme, generated, generated ? fixed_asset_seed : 0};
 
-        num_themes = 1;
-        aspect_ratio = 1.0;
-    } else {
-        asset_ptr = get_asset_ptr(names[theme]);
-        num_themes = (int)(names.size());
-        aspect_ratio = asset_ptr->width() * 1.0 / asset_ptr->height();
-    }
+    auto asset = get_basic_asset(key, [&]() {
+        auto created = std::make_shared<BasicAsset>();
+
+        if (generated) {
+            AssetGen pgen(&created->rand_gen, options.render_backend);
+            created->rand_gen.seed(fixed_asset_seed + type);
+
+            created->image = std::make_shared<QImage>(64, 64, QImage::Format_ARGB32);
+            pgen.generate_resource(created->image, 0, 5, use_block_asset(type));
+        } else {
+            created->image = get_asset_ptr(names[theme]);
+            created->aspect_ratio = created->image->width() * 1.0 / created->image->height();
+        }
 
-    basic_assets[img_idx] = asset_ptr;
-    asset_aspect_ratios[img_idx] = aspect_ratio;
-    asset_num_themes[type] = num_themes;
+        created->reflection = std::make_shared<QImage>(created->image->mirrored(true, false));
+        return created;
+    });
 
-    std::shared_ptr<QImage> reflection_ptr(new QImage(asset_ptr->mirrored(true, false)));
-    basic_reflections[img_idx] = reflection_ptr;
+    if (generated) {
+        asset_rand_gen = asset->rand_gen;
+    }
+
+    basic_assets[img_idx] = asset;
+    asset_num_themes[type] = generated ? 1 : (int)(names.size());
 }
 
 void BasicAbstractGame::fill_elem(int x, int y, int dx, int dy, char elem) {
@@ -142,7 +156,7 @@ float BasicAbstractGame::get_distance(const std::shared_ptr<Entity> &p0, const s
     return sqrt(dx * dx + dy * dy);
 }
 
-void BasicAbstractGame::check_grid_collisions(const std::shared_ptr<Entity> &ent) {
+bool BasicAbstractGame::check_grid_collisions(const std::shared_ptr<Entity> &ent) {
     float ax = ent->x;
     float ay = ent->y;
     float arx = ent->rx;
@@ -152,6 +166,7 @@ void BasicAbstractGame::check_grid_collisions(const std::shared_ptr<Entity> &ent
     int max_x = int(ax + (arx + POS_EPS));
     int min_y = int(ay - (ary + POS_EPS));
     int max_y = int(ay + (ary + POS_EPS));
+    bool handled = false;
 
     for (int x = min_x; x <= max_x; x++) {
         for (int y = min_y; y <= max_y; y++) {
@@ -159,9 +174,12 @@ void BasicAbstractGame::check_grid_collisions(const std::shared_ptr<Entity> &ent
 
             if (grid_type != SPACE) {
                 handle_grid_collision(ent, grid_type, x, y);
+                handled = true;
             }
         }
     }
+
+    return handled;
 }
 
 int BasicAbstractGame::get_obj_from_floats(float i, float j) {
@@ -204,14 +222,18 @@ int BasicAbstractGame::get_obj(int idx) {
 
 std::vector<int> BasicAbstractGame::get_cells_with_type(int type) {
     std::vector<int> cells;
+    get_cells_with_type(type, cells);
+    return cells;
+}
+
+void BasicAbstractGame::get_cells_with_type(int type, std::vector<int> &cells) {
+    cells.clear();
 
     for (int i = 0; i < grid_size; i++) {
         if (grid.get_index(i) == type) {
             cells.push_back(i);
         }
     }
-
-    return cells;
 }
 
 void BasicAbstractGame::set_obj(int idx, int elem) {
@@ -225,7 +247,7 @@ void BasicAbstractGame::set_obj(int x, int y, int elem) {
 std::shared_ptr<Entity> BasicAbstractGame::spawn_child(const std::shared_ptr<Entity> &src, int type, float obj_r, bool match_vel) {
     float vx = match_vel ? src->vx : 0;
     float vy = match_vel ? src->vy : 0;
-    auto child = std::make_shared<Entity>(src->x, src->y, vx, vy, obj_r, type);
+    auto child = entity_pool.make(src->x, src->y, vx, vy, obj_r, type);
     entities.push_back(child);
     return child;
 }
@@ -254,7 +276,7 @@ bool BasicAbstractGame::push_obj(const std::shared_ptr<Entity> &src, const std::
 
     // Rare numerical conditions (dependent on POS_EPS) could cause infinite loops.
     // For now we break quit after a small depth.
-    if (depth < 5) {
+    if (depth < MAX_PUSH_DEPTH) {
         block = sub_step(target, t_vx, t_vy, depth + 1);
     }
 
@@ -334,41 +356,66 @@ bool BasicAbstractGame::sub_step(const std::shared_ptr<Entity> &obj, float _vx,
 
     bool block2 = false;
 
-    for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
-        auto m = entities[i];
+    if (entity_hash_live) {
+        // only obj moves below, so the entities it may hit come from the entity hash, looked up again
+        // from where obj ends up whenever it is reflected or pushed
+        auto &candidates = sub_step_candidates[depth];
+        entity_hash.query(*obj, POS_EPS, candidates);
 
-        if (m == obj || m->will_erase) {
-            continue;
-        }
+        for (int k = 0; k < (int)(candidates.size()); k++) {
+            int i = candidates[k];
+            float x = obj->x;
+            float y = obj->y;
 
-        bool curr_block = false;
-
-        if (has_collision(obj, m, POS_EPS)) {
-            if (is_blocked_ents(obj, m, is_horizontal)) {
-                curr_block = true;
-            } else if (will_reflect(obj->type, m->type)) {
-                if (is_horizontal) {
-                    float delx = m->x - obj->x;
-                    float rsum = m->rx + obj->rx;
-                    obj->x += _vx > 0 ? -2 * (rsum - delx) : 2 * (rsum + delx);
-                    obj->vx = -1 * obj->vx;
-                } else {
-                    float dely = m->y - obj->y;
-                    float rsum = m->ry + obj->ry;
-                    obj->y += _vy > 0 ? -2 * (rsum - dely) : 2 * (rsum + dely);
-                    obj->vy = -1 * obj->vy;
-                }
+            block2 = sub_step_entity(obj, entities[i], _vx, _vy, depth) || block2;
+
+            if (obj->x != x || obj->y != y) {
+                entity_hash.query(*obj, POS_EPS, candidates);
+                auto next = std::upper_bound(candidates.begin(), candidates.end(), i, std::greater<int>());
+                k = (int)(next - candidates.begin()) - 1;
             }
+        }
+    } else {
+        for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
+            block2 = sub_step_entity(obj, entities[i], _vx, _vy, depth) || block2;
+        }
+    }
 
-            if (curr_block) {
-                push_obj(m, obj, is_horizontal, depth);
+    return block || block2;
+}
+
+bool BasicAbstractGame::sub_step_entity(const std::shared_ptr<Entity> &obj, const std::shared_ptr<Entity> &m, float _vx, float _vy, int depth) {
+    // nothing below adds entities, so m stays valid
+    if (m == obj || m->will_erase) {
+        return false;
+    }
+
+    bool is_horizontal = _vx != 0;
+    bool curr_block = false;
+
+    if (has_collision(obj, m, POS_EPS)) {
+        if (is_blocked_ents(obj, m, is_horizontal)) {
+            curr_block = true;
+        } else if (will_reflect(obj->type, m->type)) {
+            if (is_horizontal) {
+                float delx = m->x - obj->x;
+                float rsum = m->rx + obj->rx;
+                obj->x += _vx > 0 ? -2 * (rsum - delx) : 2 * (rsum + delx);
+                obj->vx = -1 * obj->vx;
+            } else {
+                float dely = m->y - obj->y;
+                float rsum = m->ry + obj->ry;
+                obj->y += _vy > 0 ? -2 * (rsum - dely) : 2 * (rsum + dely);
+                obj->vy = -1 * obj->vy;
             }
         }
 
-        block2 = block2 || curr_block;
+        if (curr_block) {
+            push_obj(m, obj, is_horizontal, depth);
+        }
     }
 
-    return block || block2;
+    return curr_block;
 }
 
 /*
@@ -447,6 +494,10 @@ bool BasicAbstractGame::should_preserve_type_themes(int type) {
     return false;
 }
 
+bool BasicAbstractGame::has_static_grid() {
+    return false;
+}
+
 int BasicAbstractGame::mask_theme_if_necessary(int theme, int type) {
     if (options.restrict_themes && !should_preserve_type_themes(type)) return 0;
     return theme;
@@ -509,7 +560,7 @@ float BasicAbstractGame::get_agent_acceleration_scale() {
 */
 
 std::shared_ptr<Entity> BasicAbstractGame::spawn_entity_rxy(float rx, float ry, int type, float x, float y, float w, float h, bool check_collisions) {
-    std::shared_ptr<Entity> ent(new Entity(0, 0, 0, 0, rx, ry, type));
+    auto ent = entity_pool.make(0, 0, 0, 0, rx, ry, type);
 
     reposition(ent, x, y, w, h, check_collisions);
 
@@ -564,13 +615,13 @@ std::shared_ptr<Entity> BasicAbstractGame::spawn_entity(float r, int type, float
 }
 
 std::shared_ptr<Entity> BasicAbstractGame::add_entity(float x, float y, float vx, float vy, float r, int type) {
-    std::shared_ptr<Entity> ent(new Entity(x, y, vx, vy, r, r, type));
+    auto ent = entity_pool.make(x, y, vx, vy, r, r, type);
     entities.push_back(ent);
     return ent;
 }
 
 std::shared_ptr<Entity> BasicAbstractGame::add_entity_rxy(float x, float y, float vx, float vy, float rx, float ry, int type) {
-    std::shared_ptr<Entity> ent(new Entity(x, y, vx, vy, rx, ry, type));
+    auto ent = entity_pool.make(x, y, vx, vy, rx, ry, type);
     entities.push_back(ent);
     return ent;
 }
@@ -716,14 +767,67 @@ void BasicAbstractGame::game_step() {
 
     step_entities(entities);
 
+    // with enough entities the pairs to check come from the entity hash that step_entities left up
+    // to date, handlers only move the entities they are given and the agent, and add entities to the
+    // end, so those are all that need to be re-indexed after one
+    bool use_hash = entity_hash_live;
+    int agent_idx = -1;
+
+    for (int i = 0; use_hash && i < (int)(entities.size()); i++) {
+        if (entities[i] == agent) {
+            agent_idx = i;
+        }
+    }
+
+    auto reindex = [&](int idx) {
+        if (idx >= 0) {
+            entity_hash.update(entities, idx);
+        }
+    };
+
+    // debug builds check that a handler didn't move an entity other than the ones re-indexed for it
+    auto check_hash = [&]() {
+#ifndef NDEBUG
+        entity_hash.check(entities);
+#endif
+    };
+
     for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
         auto ent = entities[i];
 
         if (has_agent_collision(ent)) {
             handle_agent_collision(ent);
+
+            if (use_hash) {
+                reindex(i);
+                reindex(agent_idx);
+                check_hash();
+            }
         }
 
-        if (ent->collides_with_entities) {
+        if (ent->collides_with_entities && use_hash) {
+            entity_hash.query(*ent, ent->collision_margin, collision_candidates);
+
+            for (int k = 0; k < (int)(collision_candidates.size()); k++) {
+                int j = collision_candidates[k];
+                if (i == j)
+                    continue;
+                auto ent2 = entities[j];
+
+                if (has_collision(ent, ent2, ent->collision_margin) && !ent->will_erase && !ent2->will_erase) {
+                    handle_collision(ent, ent2);
+
+                    // carry on from the entities below j near where ent is now
+                    reindex(i);
+                    reindex(j);
+                    reindex(agent_idx);
+                    check_hash();
+                    entity_hash.query(*ent, ent->collision_margin, collision_candidates);
+                    auto next = std::upper_bound(collision_candidates.begin(), collision_candidates.end(), j, std::greater<int>());
+                    k = (int)(next - collision_candidates.begin()) - 1;
+                }
+            }
+        } else if (ent->collides_with_entities) {
             for (int j = (int)(entities.size()) - 1; j >= 0; j--) {
                 if (i == j)
                     continue;
@@ -735,27 +839,42 @@ void BasicAbstractGame::game_step() {
             }
         }
 
-        if (ent->smart_step) {
-            check_grid_collisions(ent);
+        if (ent->smart_step && check_grid_collisions(ent) && use_hash) {
+            reindex(i);
+            reindex(agent_idx);
         }
     }
 
+    entity_hash_live = false;
+
     erase_if_needed();
 
     step_data.done = step_data.done || is_out_of_bounds(agent);
 }
 
 void BasicAbstractGame::erase_if_needed() {
-    for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
-        auto e = entities[i];
+    // compact in place so that erasing many entities stays linear and the rest keep their order
+    int kept = 0;
+
+    for (int i = 0; i < (int)(entities.size()); i++) {
+        auto &e = entities[i];
 
         if (e->will_erase || (e->auto_erase && is_out_of_bounds(e))) {
-            entities.erase(entities.begin() + i);
+            entity_pool.release(std::move(e));
+        } else {
+            if (kept != i) {
+                entities[kept] = std::move(e);
+            }
+            kept++;
         }
     }
+
+    entities.resize(kept);
 }
 
 void BasicAbstractGame::game_reset() {
+    level_version++;
+
     choose_world_dim();
     fassert(main_width > 0 && main_height > 0);
 
@@ -766,13 +885,12 @@ void BasicAbstractGame::game_reset() {
 
     background_index = rand_gen.randn((int)(main_bg_images_ptr->size()));
 
-    AssetGen bggen(&rand_gen);
-
     if (use_procgen_background) {
-        bggen.generate_resource(main_bg_images_ptr->at(background_index));
+        int size = options.generated_background_size;
+        main_bg_images_ptr->at(background_index) = get_generated_background(&rand_gen, size, size, options.render_backend);
     }
 
-    entities.clear();
+    entity_pool.release_all(entities);
 
     float ax, ay;
     float a_r = 0.4f;
@@ -785,7 +903,7 @@ void BasicAbstractGame::game_reset() {
         ay = a_r;
     }
 
-    auto _agent = std::make_shared<Entity>(ax, ay, 0, 0, a_r, PLAYER);
+    auto _agent = entity_pool.make(ax, ay, 0, 0, a_r, PLAYER);
     agent = _agent;
     agent->smart_step = true;
     agent->render_z = 1;
@@ -837,7 +955,7 @@ void BasicAbstractGame::prepare_for_drawing(float rect_height) {
     y_off = unit * (center_y - view_dim / 2);
 }
 
-void BasicAbstractGame::tile_image(QPainter &p, QImage *image, const QRectF &rect, float tile_ratio) {
+void BasicAbstractGame::tile_image(Renderer &r, QImage *image, const QRectF &rect, float tile_ratio, float alpha) {
     if (tile_ratio != 0) {
         if (tile_ratio < 0) {
             tile_ratio = -1 * tile_ratio;
@@ -849,7 +967,7 @@ void BasicAbstractGame::tile_image(QPainter &p, QImage *image, const QRectF &rec
 
             for (int i = 0; i < num_tiles; i++) {
                 QRectF tile_rect = QRectF(rect.x(), rect.y() + tile_height * i, tile_width, tile_height);
-                p.drawImage(tile_rect, *image);
+                r.draw_image(tile_rect, *image, 0, alpha);
             }
         } else {
             int num_tiles = int(rect.width() / (rect.height() * tile_ratio));
@@ -860,21 +978,21 @@ void BasicAbstractGame::tile_image(QPainter &p, QImage *image, const QRectF &rec
 
             for (int i = 0; i < num_tiles; i++) {
                 QRectF tile_rect = QRectF(rect.x() + tile_width * i, rect.y(), tile_width, tile_height);
-                p.drawImage(tile_rect, *image);
+                r.draw_image(tile_rect, *image, 0, alpha);
             }
         }
     } else {
-        p.drawImage(rect, *image);
+        r.draw_image(rect, *image, 0, alpha);
     }
 }
 
 QImage *BasicAbstractGame::lookup_asset(int img_idx, bool is_reflected) {
     initialize_asset_if_necessary(img_idx);
-    auto assets = is_reflected ? &basic_reflections : &basic_assets;
-    return assets->at(img_idx).get();
+    const auto &asset = basic_assets.at(img_idx);
+    return is_reflected ? asset->reflection.get() : asset->image.get();
 }
 
-void BasicAbstractGame::draw_image(QPainter &p, QRectF &base_rect, float rotation, bool is_reflected, int base_type, int theme, float alpha, float tile_ratio) {
+void BasicAbstractGame::draw_image(Renderer &r, QRectF &base_rect, float rotation, bool is_reflected, int base_type, int theme, float alpha, float tile_ratio) {
     int img_type = image_for_type(base_type);
 
     if (img_type < 0) {
@@ -882,7 +1000,7 @@ void BasicAbstractGame::draw_image(QPainter &p, QRectF &base_rect, float rotatio
     }
 
     if (options.use_monochrome_assets || img_type >= USE_ASSET_THRESHOLD) {
-        draw_grid_obj(p, base_rect, img_type, theme);
+        draw_grid_obj(r, base_rect, img_type, theme);
     } else {
         int img_idx = img_type + theme * MAX_ASSETS;
         fassert(theme < MAX_IMAGE_THEMES);
@@ -891,53 +1009,36 @@ void BasicAbstractGame::draw_image(QPainter &p, QRectF &base_rect, float rotatio
 
         auto asset_ptr = lookup_asset(img_idx, is_reflected);
 
-        if (alpha != 1) {
-            p.save();
-            p.setOpacity(alpha);
-        }
-
         if (rotation == 0) {
-            tile_image(p, asset_ptr, adjusted_rect, tile_ratio);
+            tile_image(r, asset_ptr, adjusted_rect, tile_ratio, alpha);
         } else {
-            p.save();
-            p.translate(adjusted_rect.x() + adjusted_rect.width() / 2, adjusted_rect.y() + adjusted_rect.height() / 2);
-            p.rotate(rotation * 180 / PI);
-            p.drawImage(QRectF(-adjusted_rect.width() / 2, -adjusted_rect.height() / 2, adjusted_rect.width(), adjusted_rect.height()), *asset_ptr);
-            p.restore();
-        }
-
-        if (alpha != 1) {
-            p.restore();
+            r.draw_image(adjusted_rect, *asset_ptr, rotation, alpha);
         }
     }
 }
 
-void BasicAbstractGame::draw_grid_obj(QPainter &p, const QRectF &rect, int type, int theme) {
+void BasicAbstractGame::draw_grid_obj(Renderer &r, const QRectF &rect, int type, int theme) {
     if (type == SPACE)
         return;
-    p.fillRect(rect, color_for_type(type, theme));
+    r.fill_rect(rect, color_for_type(type, theme));
 }
 
-void BasicAbstractGame::draw_foreground(QPainter &p, const QRect &rect) {
-    prepare_for_drawing(rect.height());
-
-    draw_entities(p, entities, -1);
-
-    int low_x, high_x, low_y, high_y;
-
+void BasicAbstractGame::get_grid_draw_range(int *low_x, int *high_x, int *low_y, int *high_y) {
     if (options.center_agent) {
         float margin = (visibility / 2.0 + 1);
-        low_x = center_x - margin;
-        high_x = center_x + margin;
-        low_y = center_y - margin;
-        high_y = center_y + margin;
+        *low_x = center_x - margin;
+        *high_x = center_x + margin;
+        *low_y = center_y - margin;
+        *high_y = center_y + margin;
     } else {
-        low_x = 0;
-        high_x = main_width - 1;
-        low_y = 0;
-        high_y = main_height - 1;
+        *low_x = 0;
+        *high_x = main_width - 1;
+        *low_y = 0;
+        *high_y = main_height - 1;
     }
+}
 
+void BasicAbstractGame::draw_grid_cells(Renderer &r, int low_x, int high_x, int low_y, int high_y) {
     for (int x = low_x; x <= high_x; x++) {
         for (int y = low_y; y <= high_y; y++) {
             int type = get_obj(x, y);
@@ -950,34 +1051,129 @@ void BasicAbstractGame::draw_foreground(QPainter &p, const QRect &rect) {
 
             QRectF r2 = get_screen_rect(x, y + 1, 1, 1, RENDER_EPS);
 
-            draw_image(p, r2, 0, false, type, theme, 1.0, 0.0);
+            draw_image(r, r2, 0, false, type, theme, 1.0, 0.0);
         }
     }
+}
 
-    draw_entities(p, entities, 0);
-    draw_entities(p, entities, 1);
+void BasicAbstractGame::draw_grid(Renderer &r) {
+    int low_x, high_x, low_y, high_y;
+    get_grid_draw_range(&low_x, &high_x, &low_y, &high_y);
+    draw_grid_cells(r, low_x, high_x, low_y, high_y);
+}
 
+void BasicAbstractGame::draw_vel_info(Renderer &r, const QRect &rect) {
     if (has_useful_vel_info && (options.paint_vel_info)) {
         float infodim = rect.height() * .2;
         QRectF dst2 = QRectF(0, 0, infodim, infodim);
         int s1 = to_shade(.5 * agent->vx / maxspeed + .5);
         int s2 = to_shade(.5 * agent->vy / max_jump + .5);
-        p.fillRect(dst2, QColor(s1, s1, s1));
+        r.fill_rect(dst2, QColor(s1, s1, s1));
 
         QRectF dst3 = QRectF(infodim, 0, infodim, infodim);
-        p.fillRect(dst3, QColor(s2, s2, s2));
+        r.fill_rect(dst3, QColor(s2, s2, s2));
+    }
+}
+
+void BasicAbstractGame::draw_foreground(Renderer &r, const QRect &rect) {
+    prepare_for_drawing(rect.height());
+
+    draw_entities(r, entities, -1);
+    draw_grid(r);
+    draw_entities(r, entities, 0);
+    draw_entities(r, entities, 1);
+    draw_vel_info(r, rect);
+}
+
+void BasicAbstractGame::draw_static_layer(Renderer &r, const QRect &rect) {
+    prepare_for_drawing(rect.height());
+
+    // the observation and the render_human frame each keep their own layer, so each one collects
+    // the cells that changed until it is drawn next
+    DirtyRect grid_dirty = grid.take_dirty();
+    StaticLayer *layer = nullptr;
+    for (auto &l : static_layers) {
+        l.dirty.add(grid_dirty);
+        if (l.w == r.width() && l.h == r.height()) {
+            layer = &l;
+        }
+    }
+    if (layer == nullptr) {
+        if ((int)(static_layers.size()) < MAX_STATIC_LAYERS) {
+            static_layers.emplace_back();
+        }
+        layer = &static_layers.back();
+        layer->w = r.width();
+        layer->h = r.height();
+        layer->level_version = -1;
+    }
+
+    size_t num_pixels = (size_t)(layer->w) * layer->h;
+
+    if (layer->level_version == level_version && layer->unit == unit && layer->x_off == x_off && layer->y_off == y_off) {
+        if (!layer->dirty.is_empty()) {
+            redraw_dirty_cells(r, layer);
+            layer->dirty = DirtyRect();
+        }
+        memcpy(r.bits(), layer->pixels.data(), num_pixels * sizeof(uint32_t));
+        return;
     }
+
+    draw_background(r, rect);
+    layer->background.resize(num_pixels);
+    memcpy(layer->background.data(), r.bits(), num_pixels * sizeof(uint32_t));
+
+    draw_grid(r);
+
+    layer->level_version = level_version;
+    layer->unit = unit;
+    layer->x_off = x_off;
+    layer->y_off = y_off;
+    layer->dirty = DirtyRect();
+    layer->pixels.resize(num_pixels);
+    memcpy(layer->pixels.data(), r.bits(), num_pixels * sizeof(uint32_t));
 }
 
-void BasicAbstractGame::set_pen_brush_color(QPainter &p, QColor color, int thickness) {
-    QBrush brush(color);
-    QPen pen(color, thickness);
-    p.setBrush(brush);
-    p.setPen(pen);
+void BasicAbstractGame::redraw_dirty_cells(Renderer &r, StaticLayer *layer) {
+    const DirtyRect &dirty = layer->dirty;
+    int w = layer->w;
+
+    // pixels the changed cells may cover, with a pixel of margin for antialiased edges
+    QRectF dirty_rect = get_screen_rect(dirty.x1, dirty.y2 + 1, dirty.x2 - dirty.x1 + 1, dirty.y2 - dirty.y1 + 1, RENDER_EPS);
+    int px1 = std::max((int)(floor(dirty_rect.left())) - 1, 0);
+    int px2 = std::min((int)(ceil(dirty_rect.right())) + 1, w);
+    int py1 = std::max((int)(floor(dirty_rect.top())) - 1, 0);
+    int py2 = std::min((int)(ceil(dirty_rect.bottom())) + 1, layer->h);
+
+    if (px1 >= px2 || py1 >= py2) {
+        return;
+    }
+
+    // draw the background and every cell that may overlap those pixels into the frame in the usual
+    // order so they end up exactly as a full redraw would leave them, then keep just those pixels,
+    // anything drawn outside of them is overwritten when the layer is copied to the frame (a clip
+    // rect would avoid the overdraw, but qt samples scaled images differently when clipping)
+    uint32_t *bits = r.bits();
+    size_t row_bytes = (px2 - px1) * sizeof(uint32_t);
+
+    for (int y = py1; y < py2; y++) {
+        memcpy(bits + y * w + px1, layer->background.data() + y * w + px1, row_bytes);
+    }
+
+    int low_x, high_x, low_y, high_y;
+    get_grid_draw_range(&low_x, &high_x, &low_y, &high_y);
+
+    // enough cells past the changed ones to cover the margin around the dirty pixels
+    int margin = 2 + (int)(ceil(4 / unit));
+    draw_grid_cells(r, std::max(low_x, dirty.x1 - margin), std::min(high_x, dirty.x2 + margin), std::max(low_y, dirty.y1 - margin), std::min(high_y, dirty.y2 + margin));
+
+    for (int y = py1; y < py2; y++) {
+        memcpy(layer->pixels.data() + y * w + px1, bits + y * w + px1, row_bytes);
+    }
 }
 
-void BasicAbstractGame::draw_background(QPainter &p, const QRect &rect) {
-    p.fillRect(rect, QColor(0, 0, 0));
+void BasicAbstractGame::draw_background(Renderer &r, const QRect &rect) {
+    r.fill_rect(rect, QColor(0, 0, 0));
 
     prepare_for_drawing(rect.height());
 
@@ -990,7 +1186,7 @@ void BasicAbstractGame::draw_background(QPainter &p, const QRect &rect) {
     std::shared_ptr<QImage> background_image = main_bg_images_ptr->at(background_index);
 
     if (bg_tile_ratio < 0) {
-        tile_image(p, background_image.get(), main_rect, bg_tile_ratio);
+        tile_image(r, background_image.get(), main_rect, bg_tile_ratio);
     } else {
         float bgw = background_image->width();
         float bgh = background_image->height();
@@ -1002,13 +1198,31 @@ void BasicAbstractGame::draw_background(QPainter &p, const QRect &rect) {
         float offset_x = bg_pct_x * extra_w;
 
         QRectF bg_rect = adjust_rect(main_rect, QRectF(-offset_x, 0, bg_ar / world_ar, 1));
-        p.drawImage(bg_rect, *background_image);
+        r.draw_image(bg_rect, *background_image);
     }
 }
 
-void BasicAbstractGame::game_draw(QPainter &p, const QRect &rect) {
-    draw_background(p, rect);
-    draw_foreground(p, rect);
+void BasicAbstractGame::game_draw(Renderer &r, const QRect &rect) {
+    // a view centered on the agent moves with it, so the layer is only kept for games where the agent
+    // moves a whole cell at a time and often stays put, the rest would redraw it every frame
+    bool can_cache = options.cache_static_layer && has_static_grid() && (!options.center_agent || grid_step);
+    // entities drawn between the background and the grid would end up in the cached layer
+    for (const auto &ent : entities) {
+        if (ent->render_z < 0) {
+            can_cache = false;
+        }
+    }
+
+    if (!can_cache) {
+        draw_background(r, rect);
+        draw_foreground(r, rect);
+        return;
+    }
+
+    draw_static_layer(r, rect);
+    draw_entities(r, entities, 0);
+    draw_entities(r, entities, 1);
+    draw_vel_info(r, rect);
 }
 
 void BasicAbstractGame::match_aspect_ratio(const std::shared_ptr<Entity> &ent, bool match_width) {
@@ -1016,9 +1230,9 @@ void BasicAbstractGame::match_aspect_ratio(const std::shared_ptr<Entity> &ent, b
     initialize_asset_if_necessary(img_idx);
 
     if (match_width) {
-        ent->ry = ent->rx / asset_aspect_ratios[img_idx];
+        ent->ry = ent->rx / basic_assets[img_idx]->aspect_ratio;
     } else {
-        ent->rx = ent->ry * asset_aspect_ratios[img_idx];
+        ent->rx = ent->ry * basic_assets[img_idx]->aspect_ratio;
     }
 }
 
@@ -1026,7 +1240,7 @@ void BasicAbstractGame::fit_aspect_ratio(const std::shared_ptr<Entity> &ent) {
     int img_idx = ent->image_type + ent->image_theme * MAX_ASSETS;
     initialize_asset_if_necessary(img_idx);
 
-    float ar = asset_aspect_ratios[img_idx];
+    float ar = basic_assets[img_idx]->aspect_ratio;
 
     if (ar > 1) {
         ent->ry = ent->rx / ar;
@@ -1049,18 +1263,18 @@ bool BasicAbstractGame::should_draw_entity(const std::shared_ptr<Entity> &entity
     return true;
 }
 
-void BasicAbstractGame::draw_entity(QPainter &p, const std::shared_ptr<Entity> &ent) {
+void BasicAbstractGame::draw_entity(Renderer &r, const std::shared_ptr<Entity> &ent) {
     if (should_draw_entity(ent)) {
         QRectF r1 = get_object_rect(ent);
         float tile_ratio = get_tile_aspect_ratio(ent);
-        draw_image(p, r1, ent->rotation, ent->is_reflected, ent->image_type, ent->image_theme, ent->alpha, tile_ratio);
+        draw_image(r, r1, ent->rotation, ent->is_reflected, ent->image_type, ent->image_theme, ent->alpha, tile_ratio);
     }
 }
 
-void BasicAbstractGame::draw_entities(QPainter &p, const std::vector<std::shared_ptr<Entity>> &to_draw, int render_z) {
+void BasicAbstractGame::draw_entities(Renderer &r, const std::vector<std::shared_ptr<Entity>> &to_draw, int render_z) {
     for (const auto &m : to_draw) {
         if (m->render_z == render_z) {
-            draw_entity(p, m);
+            draw_entity(r, m);
         }
     }
 }
@@ -1086,6 +1300,13 @@ bool BasicAbstractGame::is_out_of_bounds(const std::shared_ptr<Entity> &e1) {
 void BasicAbstractGame::step_entities(const std::vector<std::shared_ptr<Entity>> &given) {
     int entities_count = (int)(given.size());
 
+    // when every entity is stepped, the entity hash follows them as they move, so that sub_step and
+    // then game_step can look up the entities near one
+    entity_hash_live = &given == &entities && use_entity_hash();
+    if (entity_hash_live) {
+        entity_hash.build(entities, main_width, main_height);
+    }
+
     for (int i = entities_count - 1; i >= 0; i--) {
         auto ent = given.at(i);
 
@@ -1094,9 +1315,17 @@ void BasicAbstractGame::step_entities(const std::vector<std::shared_ptr<Entity>>
         }
 
         ent->step();
+
+        if (entity_hash_live) {
+            entity_hash.update(entities, i);
+        }
     }
 }
 
+bool BasicAbstractGame::use_entity_hash() {
+    return options.entity_hash_min_size >= 0 && (int)(entities.size()) > options.entity_hash_min_size;
+}
+
 float BasicAbstractGame::rand_pos(float r, float min, float max) {
     fassert(min <= max);
 
@@ -1157,10 +1386,15 @@ void BasicAbstractGame::write_entities(WriteBuffer *b, std::vector<std::shared_p
     }
 }
 
+int64_t BasicAbstractGame::get_entity_allocations() {
+    return entity_pool.allocations;
+}
+
 void BasicAbstractGame::read_entities(ReadBuffer *b, std::vector<std::shared_ptr<Entity>> &ents) {
+    entity_pool.release_all(ents);
     ents.resize(b->read_int());
     for (size_t i = 0; i < ents.size(); i++) {
-        auto e = std::make_shared<Entity>();
+        auto e = entity_pool.make();
         e->deserialize(b);
         ents[i] = e;
     }
@@ -1175,11 +1409,9 @@ void BasicAbstractGame::serialize(WriteBuffer *b) {
 
     fassert(!options.use_generated_assets);
     // these will be cleared and re-generated instead of being saved
-//     std::vector<std::shared_ptr<QImage>> basic_assets;
-//     std::vector<std::shared_ptr<QImage>> basic_reflections;
+//     std::vector<std::shared_ptr<const BasicAsset>> basic_assets;
 //     std::vector<std::shared_ptr<QImage>> *main_bg_images_ptr;
 
-    // std::vector<float> asset_aspect_ratios;
     // std::vector<int> asset_num_themes;
 
     b->write_int(use_procgen_background);
@@ -1224,6 +1456,7 @@ void BasicAbstractGame::serialize(WriteBuffer *b) {
 
 void BasicAbstractGame::deserialize(ReadBuffer *b) {
     Game::deserialize(b);
+    level_version++;
 
     grid_size = b->read_int();
 
@@ -1239,12 +1472,10 @@ void BasicAbstractGame::deserialize(ReadBuffer *b) {
 
     // when restoring state (to the same game type) with generated assets disabled, these data structures contain cached
     // asset data, and missing data will be filled in the same way in all environments
-//     std::vector<std::shared_ptr<QImage>> basic_assets;
-//     std::vector<std::shared_ptr<QImage>> basic_reflections;
+//     std::vector<std::shared_ptr<const BasicAsset>> basic_assets;
     // main_bg_images_ptr is set in game_init for all supported games, so it should always be the same
 //     std::vector<std::shared_ptr<QImage>> *main_bg_images_ptr;
 
-    // std::vector<float> asset_aspect_ratios;
     // std::vector<int> asset_num_themes;
 
     use_procgen_background = b->read_int();
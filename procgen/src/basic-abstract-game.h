@@ -12,6 +12,24 @@ Base game class used by all currently existing games
 #include "game.h"
 #include "grid.h"
 #include "cpp-utils.h"
+#include "asset-cache.h"
+#include "entity-hash.h"
+#include "entity-pool.h"
+
+// pixels of the background and grid from an earlier frame of one size, along with the level version
+// and view they were drawn with and the grid cells that changed since
+struct StaticLayer {
+    int w = 0;
+    int h = 0;
+    int level_version = -1;
+    float unit = 0.0f;
+    float x_off = 0.0f;
+    float y_off = 0.0f;
+    DirtyRect dirty;
+    std::vector<uint32_t> pixels;
+    // just the background, used to redraw the parts of the grid that changed
+    std::vector<uint32_t> background;
+};
 
 class BasicAbstractGame : public Game {
   public:
@@ -23,10 +41,11 @@ class BasicAbstractGame : public Game {
     // Game methods
     void game_step() override;
     void game_reset() override;
-    void game_draw(QPainter &p, const QRect &rect) override;
+    void game_draw(Renderer &r, const QRect &rect) override;
     void game_init() override;
     void serialize(WriteBuffer *b) override;
     void deserialize(ReadBuffer *b) override;
+    int64_t get_entity_allocations() override;
 
     void write_entities(WriteBuffer *b, std::vector<std::shared_ptr<Entity>> &ents);
     void read_entities(ReadBuffer *b, std::vector<std::shared_ptr<Entity>> &ents);
@@ -46,20 +65,22 @@ class BasicAbstractGame : public Game {
     virtual int theme_for_grid_obj(int type);
     virtual bool should_preserve_type_themes(int type);
     virtual QColor color_for_type(int type, int theme);
-    virtual void draw_grid_obj(QPainter &p, const QRectF &rect, int type, int theme);
+    virtual void draw_grid_obj(Renderer &r, const QRectF &rect, int type, int theme);
     virtual void choose_world_dim();
     virtual bool should_draw_entity(const std::shared_ptr<Entity> &entity);
     virtual void set_action_xy(int move_action);
     virtual void choose_center(float &cx, float &cy);
     virtual void update_agent_velocity();
     virtual QRectF get_adjusted_image_rect(int type, const QRectF &rect);
+    // true if grid cells are drawn within their own rect based only on their type and state that is
+    // fixed for the level, which lets the background and grid be drawn once and reused until the view
+    // changes, with only the changed cells redrawn after writes to the grid
+    virtual bool has_static_grid();
 
     void reserved_asset_for_type(int type, std::vector<std::string> &names);
     void choose_step_random_theme(const std::shared_ptr<Entity> &ent);
     bool use_procgen_asset(int type);
     void decay_agent_velocity();
-    void tile_image(QPainter &p, std::shared_ptr<QImage> image, QRectF &rect, float tile_ratio);
-    void set_pen_brush_color(QPainter &p, QColor color, int thickness = 1);
     void basic_step_object(const std::shared_ptr<Entity> &obj);
     std::shared_ptr<Entity> spawn_entity_rxy(float rx, float ry, int type, float x, float y, float w, float h, bool check_collisions = true);
     std::shared_ptr<Entity> spawn_entity(float r, int type, float x, float y, float w, float h, bool check_collisions = true);
@@ -79,14 +100,17 @@ class BasicAbstractGame : public Game {
     int get_obj_from_floats(float i, float j);
     int get_agent_index();
     std::vector<int> get_cells_with_type(int type);
+    // fills cells instead of returning a new vector, so a scratch buffer can be reused
+    void get_cells_with_type(int type, std::vector<int> &cells);
 
-    void check_grid_collisions(const std::shared_ptr<Entity> &src);
+    // returns true if handle_grid_collision was called
+    bool check_grid_collisions(const std::shared_ptr<Entity> &src);
     float get_distance(const std::shared_ptr<Entity> &p0, const std::shared_ptr<Entity> &p1);
     void match_aspect_ratio(const std::shared_ptr<Entity> &ent, bool match_width = true);
     void fit_aspect_ratio(const std::shared_ptr<Entity> &ent);
     void choose_random_theme(const std::shared_ptr<Entity> &ent);
     int mask_theme_if_necessary(int theme, int type);
-    void tile_image(QPainter &p, QImage *image, const QRectF &rect, float tile_ratio);
+    void tile_image(Renderer &r, QImage *image, const QRectF &rect, float tile_ratio, float alpha = 1);
 
     float rand_pos(float r, float max);
     float rand_pos(float r, float min, float max);
@@ -102,7 +126,7 @@ class BasicAbstractGame : public Game {
     QRectF get_abs_rect(float x, float y, float dx, float dy);
     QRectF get_object_rect(const std::shared_ptr<Entity> &obj);
 
-    void draw_foreground(QPainter &p, const QRect &rect);
+    void draw_foreground(Renderer &r, const QRect &rect);
 
     void step_entities(const std::vector<std::shared_ptr<Entity>> &given);
 
@@ -114,11 +138,10 @@ class BasicAbstractGame : public Game {
   protected:
     std::shared_ptr<Entity> agent;
     std::vector<std::shared_ptr<Entity>> entities;
-    std::vector<std::shared_ptr<QImage>> basic_assets;
-    std::vector<std::shared_ptr<QImage>> basic_reflections;
+    // shared with the other environments of the game through the asset cache
+    std::vector<std::shared_ptr<const BasicAsset>> basic_assets;
     std::vector<std::shared_ptr<QImage>> *main_bg_images_ptr;
 
-    std::vector<float> asset_aspect_ratios;
     std::vector<int> asset_num_themes;
     
     bool use_procgen_background = false;
@@ -158,17 +181,44 @@ class BasicAbstractGame : public Game {
     float visibility = 0.0f;
     float min_visibility = 0.0f;
 
+    // erased entities are handed back out by make(), so games should spawn through it
+    EntityPool entity_pool;
+
   private:
     Grid<int> grid;
+    // incremented on every new level and restored state
+    int level_version = 0;
+    std::vector<StaticLayer> static_layers;
+    // one for the observation and one for the render_human frame, a frame of any other size takes
+    // over the last one
+    static const int MAX_STATIC_LAYERS = 2;
+
+    // push_obj stops recursing into sub_step past this depth
+    static const int MAX_PUSH_DEPTH = 5;
+
+    // broad phase for collisions between entities in step_entities and game_step, not saved with the
+    // state, live while it follows every entity
+    EntityHash entity_hash;
+    bool entity_hash_live = false;
+    std::vector<int> collision_candidates;
+    std::vector<int> sub_step_candidates[MAX_PUSH_DEPTH + 1];
 
     QImage *lookup_asset(int img_idx, bool is_reflected = false);
     void initialize_asset_if_necessary(int img_idx);
     void prepare_for_drawing(float rect_height);
-    void draw_background(QPainter &p, const QRect &rect);
-    void draw_entity(QPainter &p, const std::shared_ptr<Entity> &to_draw);
-    void draw_entities(QPainter &p, const std::vector<std::shared_ptr<Entity>> &to_draw, int render_z = 0);
-    void draw_image(QPainter &p, QRectF &rect, float rotation, bool is_reflected, int img_idx, int theme, float alpha, float tile_ratio);
+    void draw_background(Renderer &r, const QRect &rect);
+    void draw_grid(Renderer &r);
+    void draw_grid_cells(Renderer &r, int low_x, int high_x, int low_y, int high_y);
+    void get_grid_draw_range(int *low_x, int *high_x, int *low_y, int *high_y);
+    void draw_static_layer(Renderer &r, const QRect &rect);
+    void redraw_dirty_cells(Renderer &r, StaticLayer *layer);
+    void draw_vel_info(Renderer &r, const QRect &rect);
+    void draw_entity(Renderer &r, const std::shared_ptr<Entity> &to_draw);
+    void draw_entities(Renderer &r, const std::vector<std::shared_ptr<Entity>> &to_draw, int render_z = 0);
+    void draw_image(Renderer &r, QRectF &rect, float rotation, bool is_reflected, int img_idx, int theme, float alpha, float tile_ratio);
 
     bool sub_step(const std::shared_ptr<Entity> &obj, float _vx, float _vy, int depth);
+    bool sub_step_entity(const std::shared_ptr<Entity> &obj, const std::shared_ptr<Entity> &m, float _vx, float _vy, int depth);
+    bool use_entity_hash();
     bool should_erase(const std::shared_ptr<Entity> &e1);
 };
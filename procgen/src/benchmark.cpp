@@ -0,0 +1,354 @@
+/*
+
+Measures the throughput of each registered game without going through python
+
+For each game this creates a VecGame and reports:
+
+    steps_per_sec           environment steps per second through VecGame::act() and observe(), so
+                            including the stepping threads and scheduling
+    step_latency_p50_ns     latency of a single Game::step() on the calling thread, which includes
+    step_latency_p99_ns     rendering the observation
+    render_ns_per_frame     time to draw one observation
+    resets_per_sec          Game::reset() calls per second, which generate a new level
+
+Usage: procgen-benchmark [--games bigfish,coinrun] [--num-envs 64] [--num-threads 4]
+                         [--stepping-mode queue] [--distribution-mode hard] [--render-backend qt]
+                         [--steps 500] [--latency-steps 2000] [--frames 1000] [--resets 100]
+                         [--resource-root path/] [--json out.json]
+
+*/
+
+#include "vecgame.h"
+#include "vecoptions.h"
+#include "game.h"
+#include "game-registry.h"
+#include "cpp-utils.h"
+#include "randgen.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <list>
+#include <map>
+#include <sstream>
+
+struct BenchConfig {
+    std::vector<std::string> games;
+    int num_envs = 64;
+    int num_threads = 4;
+    std::string stepping_mode = "queue";
+    std::string distribution_mode = "hard";
+    std::string render_backend = "qt";
+    int steps = 500;
+    int latency_steps = 2000;
+    int frames = 1000;
+    int resets = 100;
+    std::string resource_root = PROCGEN_RESOURCE_ROOT;
+    std::string json_path;
+};
+
+struct BenchResult {
+    std::string name;
+    double steps_per_sec = 0;
+    double resets_per_sec = 0;
+    double render_ns_per_frame = 0;
+    int64_t step_latency_p50_ns = 0;
+    int64_t step_latency_p99_ns = 0;
+};
+
+// should match the dicts in env.py
+const std::map<std::string, int> STEPPING_MODES = {{"queue", QueueStepping}, {"work_stealing", WorkStealingStepping}, {"chunked", ChunkedStepping}};
+const std::map<std::string, int> DISTRIBUTION_MODES = {{"easy", EasyMode}, {"hard", HardMode}, {"extreme", ExtremeMode}, {"memory", MemoryMode}};
+const std::map<std::string, int> RENDER_BACKENDS = {{"qt", QtRenderBackend}, {"software", SoftwareRenderBackend}};
+
+// same as len(self.combos) in env.py
+const int NUM_ACTIONS = 15;
+
+const char *USAGE = "Usage: procgen-benchmark [--games bigfish,coinrun] [--num-envs 64] [--num-threads 4]\n"
+                    "                         [--stepping-mode queue] [--distribution-mode hard] [--render-backend qt]\n"
+                    "                         [--steps 500] [--latency-steps 2000] [--frames 1000] [--resets 100]\n"
+                    "                         [--resource-root path/] [--json out.json]\n";
+
+typedef std::chrono::steady_clock Clock;
+
+static int64_t elapsed_ns(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+static int lookup_mode(const std::map<std::string, int> &modes, const std::string &name, const char *what) {
+    auto it = modes.find(name);
+    if (it == modes.end()) {
+        fatal("invalid %s %s\n", what, name.c_str());
+    }
+    return it->second;
+}
+
+// libenv options along with the values they point to
+class OptionList {
+  public:
+    std::vector<libenv_option> items;
+
+    void add_string(const char *name, const std::string &value) {
+        strings.push_back(value);
+        add(name, LIBENV_DTYPE_UINT8, (int)(value.size()), (void *)(strings.back().data()));
+    }
+
+    void add_int(const char *name, int32_t value) {
+        ints.push_back(value);
+        add(name, LIBENV_DTYPE_INT32, 1, &ints.back());
+    }
+
+    struct libenv_options get() {
+        struct libenv_options options;
+        options.items = items.data();
+        options.count = (int)(items.size());
+        return options;
+    }
+
+  private:
+    std::list<std::string> strings;
+    std::list<int32_t> ints;
+
+    void add(const char *name, enum libenv_dtype dtype, int count, void *data) {
+        libenv_option opt;
+        strcpy(opt.name, name);
+        opt.dtype = dtype;
+        opt.count = count;
+        opt.data = data;
+        items.push_back(opt);
+    }
+};
+
+static size_t tensor_bytes(const struct libenv_tensortype &t) {
+    size_t size = t.dtype == LIBENV_DTYPE_UINT8 ? 1 : 4;
+    for (int i = 0; i < t.ndim; i++) {
+        size *= t.shape[i];
+    }
+    return size;
+}
+
+// the buffers of one buffer set, laid out per environment
+class Buffers {
+  public:
+    std::vector<std::vector<void *>> ac;
+    std::vector<std::vector<void *>> ob;
+    std::vector<std::vector<void *>> info;
+    std::vector<float> rew;
+    std::vector<uint8_t> first;
+
+    Buffers(const VecGame &venv) {
+        ac = allocate(venv.action_types, venv.num_envs);
+        ob = allocate(venv.observation_types, venv.num_envs);
+        info = allocate(venv.info_types, venv.num_envs);
+        rew.resize(venv.num_envs);
+        first.resize(venv.num_envs);
+    }
+
+  private:
+    std::list<std::vector<uint8_t>> storage;
+
+    std::vector<std::vector<void *>> allocate(const std::vector<struct libenv_tensortype> &types, int num_envs) {
+        std::vector<std::vector<void *>> result(num_envs);
+        for (int e = 0; e < num_envs; e++) {
+            for (const auto &t : types) {
+                storage.emplace_back(tensor_bytes(t));
+                result[e].push_back(storage.back().data());
+            }
+        }
+        return result;
+    }
+};
+
+static BenchResult bench_game(const std::string &name, const BenchConfig &cfg) {
+    OptionList opts;
+    opts.add_string("env_name", name);
+    opts.add_int("num_levels", 0);
+    opts.add_int("start_level", 0);
+    opts.add_int("num_actions", NUM_ACTIONS);
+    opts.add_int("rand_seed", 0);
+    opts.add_int("num_threads", cfg.num_threads);
+    opts.add_int("stepping_mode", lookup_mode(STEPPING_MODES, cfg.stepping_mode, "stepping mode"));
+    opts.add_int("distribution_mode", lookup_mode(DISTRIBUTION_MODES, cfg.distribution_mode, "distribution mode"));
+    opts.add_int("render_backend", lookup_mode(RENDER_BACKENDS, cfg.render_backend, "render backend"));
+    opts.add_string("resource_root", cfg.resource_root);
+
+    VecGame venv(cfg.num_envs, VecOptions(opts.get()));
+    Buffers bufs(venv);
+    venv.set_buffers(bufs.ac, bufs.ob, bufs.info, bufs.rew.data(), bufs.first.data());
+    venv.observe();
+
+    BenchResult result;
+    result.name = name;
+
+    RandGen rand_gen;
+    rand_gen.seed(0);
+
+    auto act = [&]() {
+        for (int e = 0; e < cfg.num_envs; e++) {
+            *(int32_t *)(bufs.ac[e][0]) = rand_gen.randn(NUM_ACTIONS);
+        }
+        venv.act();
+        venv.observe();
+    };
+
+    // a few steps first so that lazily loaded assets and scratch buffers don't count
+    for (int i = 0; i < 10; i++) {
+        act();
+    }
+
+    auto start = Clock::now();
+    for (int i = 0; i < cfg.steps; i++) {
+        act();
+    }
+    result.steps_per_sec = (double)(cfg.steps) * cfg.num_envs / (elapsed_ns(start) * 1e-9);
+
+    // the stepping threads are idle between act() calls, so the calling thread can use a game
+    venv.wait_for_stepping_threads();
+    auto game = venv.games[0];
+
+    std::vector<int64_t> latencies(cfg.latency_steps);
+    for (int i = 0; i < cfg.latency_steps; i++) {
+        game->action = rand_gen.randn(NUM_ACTIONS);
+        auto step_start = Clock::now();
+        game->step();
+        latencies[i] = elapsed_ns(step_start);
+    }
+    if (cfg.latency_steps > 0) {
+        std::sort(latencies.begin(), latencies.end());
+        result.step_latency_p50_ns = latencies[(latencies.size() - 1) / 2];
+        result.step_latency_p99_ns = latencies[(latencies.size() - 1) * 99 / 100];
+    }
+
+    start = Clock::now();
+    for (int i = 0; i < cfg.frames; i++) {
+        game->render_to_buf(game->render_buf, RES_W, RES_H, false);
+    }
+    result.render_ns_per_frame = (double)(elapsed_ns(start)) / std::max(cfg.frames, 1);
+
+    start = Clock::now();
+    for (int i = 0; i < cfg.resets; i++) {
+        game->reset();
+    }
+    result.resets_per_sec = cfg.resets / (elapsed_ns(start) * 1e-9);
+
+    return result;
+}
+
+static void write_json(FILE *f, const BenchConfig &cfg, const std::vector<BenchResult> &results) {
+    fprintf(f, "{\n");
+    fprintf(f, "  \"num_envs\": %d,\n", cfg.num_envs);
+    fprintf(f, "  \"num_threads\": %d,\n", cfg.num_threads);
+    fprintf(f, "  \"stepping_mode\": \"%s\",\n", cfg.stepping_mode.c_str());
+    fprintf(f, "  \"distribution_mode\": \"%s\",\n", cfg.distribution_mode.c_str());
+    fprintf(f, "  \"render_backend\": \"%s\",\n", cfg.render_backend.c_str());
+    fprintf(f, "  \"games\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto &r = results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"steps_per_sec\": %.1f, \"resets_per_sec\": %.1f, \"render_ns_per_frame\": %.0f, \"step_latency_p50_ns\": %lld, \"step_latency_p99_ns\": %lld}%s\n",
+                r.name.c_str(), r.steps_per_sec, r.resets_per_sec, r.render_ns_per_frame,
+                (long long)(r.step_latency_p50_ns), (long long)(r.step_latency_p99_ns),
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
+}
+
+static std::vector<std::string> split_names(const std::string &names) {
+    std::vector<std::string> result;
+    std::stringstream stream(names);
+    std::string name;
+    while (std::getline(stream, name, ',')) {
+        if (name != "") {
+            result.push_back(name);
+        }
+    }
+    return result;
+}
+
+static BenchConfig parse_args(int argc, char **argv) {
+    BenchConfig cfg;
+    std::string games;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            printf("%s", USAGE);
+            exit(0);
+        }
+        if (i + 1 >= argc) {
+            fatal("missing value for %s\n", arg.c_str());
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--games") {
+            games = value;
+        } else if (arg == "--num-envs") {
+            cfg.num_envs = std::stoi(value);
+        } else if (arg == "--num-threads") {
+            cfg.num_threads = std::stoi(value);
+        } else if (arg == "--stepping-mode") {
+            cfg.stepping_mode = value;
+        } else if (arg == "--distribution-mode") {
+            cfg.distribution_mode = value;
+        } else if (arg == "--render-backend") {
+            cfg.render_backend = value;
+        } else if (arg == "--steps") {
+            cfg.steps = std::stoi(value);
+        } else if (arg == "--latency-steps") {
+            cfg.latency_steps = std::stoi(value);
+        } else if (arg == "--frames") {
+            cfg.frames = std::stoi(value);
+        } else if (arg == "--resets") {
+            cfg.resets = std::stoi(value);
+        } else if (arg == "--resource-root") {
+            cfg.resource_root = value;
+        } else if (arg == "--json") {
+            cfg.json_path = value;
+        } else {
+            fatal("unknown argument %s\n", arg.c_str());
+        }
+    }
+
+    if (games == "") {
+        for (const auto &entry : *globalGameRegistry) {
+            cfg.games.push_back(entry.first);
+        }
+    } else {
+        cfg.games = split_names(games);
+    }
+
+    fassert(cfg.num_envs > 0);
+    fassert(cfg.steps > 0 && cfg.resets > 0);
+
+    return cfg;
+}
+
+int main(int argc, char **argv) {
+    BenchConfig cfg = parse_args(argc, argv);
+
+    printf("num_envs=%d num_threads=%d stepping_mode=%s distribution_mode=%s render_backend=%s\n",
+           cfg.num_envs, cfg.num_threads, cfg.stepping_mode.c_str(), cfg.distribution_mode.c_str(), cfg.render_backend.c_str());
+    printf("%-14s %12s %12s %14s %12s %12s\n", "game", "steps/s", "resets/s", "render ns", "p50 step ns", "p99 step ns");
+
+    std::vector<BenchResult> results;
+    for (const auto &name : cfg.games) {
+        if (globalGameRegistry->count(name) == 0) {
+            fatal("unknown game %s\n", name.c_str());
+        }
+        auto r = bench_game(name, cfg);
+        printf("%-14s %12.0f %12.1f %14.0f %12lld %12lld\n", r.name.c_str(), r.steps_per_sec, r.resets_per_sec,
+               r.render_ns_per_frame, (long long)(r.step_latency_p50_ns), (long long)(r.step_latency_p99_ns));
+        fflush(stdout);
+        results.push_back(r);
+    }
+
+    if (cfg.json_path != "") {
+        FILE *f = fopen(cfg.json_path.c_str(), "w");
+        if (f == nullptr) {
+            fatal("failed to open %s\n", cfg.json_path.c_str());
+        }
+        write_json(f, cfg, results);
+        fclose(f);
+    }
+
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "entity-hash.h"
+#include "cpp-utils.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+// float rounding in has_collision and here can disagree by an ulp, so the bounds are padded
+const float HASH_PADDING = 0.01f;
+
+void EntityHash::cell_range(float center, float radius, int size, int *lo, int *hi) const {
+    float r = std::max(radius, 0.0f) + HASH_PADDING;
+    float low = std::floor(center - r);
+    float high = std::floor(center + r);
+
+    // also handles nan, which never collides with anything
+    *lo = low >= 0 ? (low < size ? (int)(low) : size - 1) : 0;
+    *hi = high >= 0 ? (high < size ? (int)(high) : size - 1) : 0;
+}
+
+EntityHash::CellRange EntityHash::entity_range(const Entity &e) const {
+    CellRange r;
+    cell_range(e.x, e.rx, w, &r.x1, &r.x2);
+    cell_range(e.y, e.ry, h, &r.y1, &r.y2);
+    return r;
+}
+
+void EntityHash::insert(int idx, const CellRange &r) {
+    for (int y = r.y1; y <= r.y2; y++) {
+        for (int x = r.x1; x <= r.x2; x++) {
+            auto &cell = cells[y * w + x];
+            cell.push_back(idx);
+            max_cell_size = std::max(max_cell_size, cell.size());
+        }
+    }
+}
+
+void EntityHash::remove(int idx, const CellRange &r) {
+    for (int y = r.y1; y <= r.y2; y++) {
+        for (int x = r.x1; x <= r.x2; x++) {
+            auto &cell = cells[y * w + x];
+            auto it = std::find(cell.begin(), cell.end(), idx);
+            fassert(it != cell.end());
+            *it = cell.back();
+            cell.pop_back();
+        }
+    }
+}
+
+void EntityHash::add_new(const std::vector<std::shared_ptr<Entity>> &entities) {
+    for (int i = (int)(ranges.size()); i < (int)(entities.size()); i++) {
+        ranges.push_back(entity_range(*entities[i]));
+        insert(i, ranges.back());
+    }
+}
+
+void EntityHash::build(const std::vector<std::shared_ptr<Entity>> &entities, int _w, int _h) {
+    // only the cells that were in use need clearing, and they keep their capacity for the next build
+    for (const auto &r : ranges) {
+        for (int y = r.y1; y <= r.y2; y++) {
+            for (int x = r.x1; x <= r.x2; x++) {
+                cells[y * w + x].clear();
+            }
+        }
+    }
+    ranges.clear();
+
+    w = std::max(_w, 1);
+    h = std::max(_h, 1);
+    size_t first_new = cells.size();
+    cells.resize(w * h);
+
+    if (max_cell_size > cell_capacity) {
+        cell_capacity = max_cell_size;
+        first_new = 0;
+    }
+    for (size_t i = first_new; i < cells.size(); i++) {
+        cells[i].reserve(cell_capacity);
+    }
+
+    add_new(entities);
+}
+
+void EntityHash::update(const std::vector<std::shared_ptr<Entity>> &entities, int idx) {
+    add_new(entities);
+
+    CellRange r = entity_range(*entities[idx]);
+
+    if (!(r == ranges[idx])) {
+        remove(idx, ranges[idx]);
+        insert(idx, r);
+        ranges[idx] = r;
+    }
+}
+
+void EntityHash::query(const Entity &ent, float margin, std::vector<int> &indices) const {
+    indices.clear();
+
+    // has_collision is |dx| < rx1 + rx2 + margin, which needs the bounds of the other entity to come
+    // within rx1 + margin of the center of ent
+    int x1, x2, y1, y2;
+    cell_range(ent.x, ent.rx + margin, w, &x1, &x2);
+    cell_range(ent.y, ent.ry + margin, h, &y1, &y2);
+
+    for (int y = y1; y <= y2; y++) {
+        for (int x = x1; x <= x2; x++) {
+            const auto &cell = cells[y * w + x];
+            indices.insert(indices.end(), cell.begin(), cell.end());
+        }
+    }
+
+    std::sort(indices.begin(), indices.end(), std::greater<int>());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+}
+
+void EntityHash::check(const std::vector<std::shared_ptr<Entity>> &entities) const {
+    fassert(ranges.size() == entities.size());
+
+    for (int i = 0; i < (int)(entities.size()); i++) {
+        fassert(ranges[i] == entity_range(*entities[i]));
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+
+A broad phase for collisions between entities
+
+Entities are indexed by the cells of the world grid that their bounds overlap, so finding the
+entities that might collide with one only looks at the entities near it. Entities outside the world
+are put in the nearest cells on its edge.
+
+The index of an entity is its position in the entities vector. After build(), entities that move or
+resize are re-indexed one at a time with update(), which also indexes any entities added to the end
+of the vector since.
+
+*/
+
+#include "entity.h"
+#include <vector>
+
+class EntityHash {
+  public:
+    void build(const std::vector<std::shared_ptr<Entity>> &entities, int w, int h);
+    void update(const std::vector<std::shared_ptr<Entity>> &entities, int idx);
+
+    // indices of the entities that has_collision(ent, other, margin) may be true for, highest index
+    // first, including ent itself if it is indexed
+    void query(const Entity &ent, float margin, std::vector<int> &indices) const;
+
+    // fails if any entity has moved or resized since it was last indexed, or has not been indexed
+    void check(const std::vector<std::shared_ptr<Entity>> &entities) const;
+
+  private:
+    struct CellRange {
+        int x1, x2, y1, y2;
+
+        bool operator==(const CellRange &o) const {
+            return x1 == o.x1 && x2 == o.x2 && y1 == o.y1 && y2 == o.y2;
+        }
+    };
+
+    int w = 0;
+    int h = 0;
+    // entity indices in each cell, in no particular order, row major
+    std::vector<std::vector<int>> cells;
+    // every cell has room for as many entities as the fullest cell has held, so once the entities
+    // have moved around the level, indexing them no longer allocates
+    size_t cell_capacity = 0;
+    size_t max_cell_size = 0;
+    // the cells each indexed entity is in
+    std::vector<CellRange> ranges;
+
+    void cell_range(float center, float radius, int size, int *lo, int *hi) const;
+    CellRange entity_range(const Entity &e) const;
+    void insert(int idx, const CellRange &r);
+    void remove(int idx, const CellRange &r);
+    void add_new(const std::vector<std::shared_ptr<Entity>> &entities);
+};
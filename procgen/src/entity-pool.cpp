@@ -0,0 +1,53 @@
+#include "entity-pool.h"
+
+std::shared_ptr<Entity> EntityPool::reuse() {
+    while (!free_entities.empty()) {
+        auto ent = std::move(free_entities.back());
+        free_entities.pop_back();
+
+        if (ent.use_count() == 1) {
+            return ent;
+        }
+    }
+
+    return nullptr;
+}
+
+std::shared_ptr<Entity> EntityPool::make() {
+    auto ent = reuse();
+
+    if (ent == nullptr) {
+        allocations++;
+        return std::make_shared<Entity>();
+    }
+
+    *ent = Entity();
+    return ent;
+}
+
+std::shared_ptr<Entity> EntityPool::make(float x, float y, float vx, float vy, float rx, float ry, int type) {
+    auto ent = reuse();
+
+    if (ent == nullptr) {
+        allocations++;
+        return std::make_shared<Entity>(x, y, vx, vy, rx, ry, type);
+    }
+
+    *ent = Entity(x, y, vx, vy, rx, ry, type);
+    return ent;
+}
+
+std::shared_ptr<Entity> EntityPool::make(float x, float y, float vx, float vy, float r, int type) {
+    return make(x, y, vx, vy, r, r, type);
+}
+
+void EntityPool::release(std::shared_ptr<Entity> &&ent) {
+    free_entities.push_back(std::move(ent));
+}
+
+void EntityPool::release_all(std::vector<std::shared_ptr<Entity>> &ents) {
+    for (auto &ent : ents) {
+        release(std::move(ent));
+    }
+    ents.clear();
+}
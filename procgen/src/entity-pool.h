@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+
+Recycles the entities a game erases so that spawning new ones doesn't allocate
+
+Erased entities are kept along with their shared_ptr control blocks and handed out again by make(),
+reset to the state the matching Entity constructor would give them. An entity that game code still
+holds a reference to is never handed out again, it is just dropped from the pool.
+
+*/
+
+#include "entity.h"
+#include <vector>
+#include <cstdint>
+
+class EntityPool {
+  public:
+    // number of entities that had to be allocated because the pool had none free
+    int64_t allocations = 0;
+
+    std::shared_ptr<Entity> make();
+    std::shared_ptr<Entity> make(float x, float y, float vx, float vy, float rx, float ry, int type);
+    std::shared_ptr<Entity> make(float x, float y, float vx, float vy, float r, int type);
+
+    void release(std::shared_ptr<Entity> &&ent);
+    void release_all(std::vector<std::shared_ptr<Entity>> &ents);
+
+  private:
+    std::vector<std::shared_ptr<Entity>> free_entities;
+
+    std::shared_ptr<Entity> reuse();
+};
@@ -1,25 +1,87 @@
 
 #include "game.h"
 #include "vecoptions.h"
+#include "alloc-counter.h"
 
 // this should be updated whenever the state format or environments may have changed
 const int SERIALIZE_VERSION = 0;
 
-void bgr32_to_rgb888(void *dst_rgb888, void *src_bgr32, int w, int h) {
-    uint8_t *src = (uint8_t *)src_bgr32;
-    uint8_t *dst = (uint8_t *)dst_rgb888;
-
-    for (int y = 0; y < h; y++) {
-        uint8_t *s = src + y * w * 4;
-        uint8_t *d = dst + y * w * 3;
-        for (int x = 0; x < w; x++) {
-            d[0] = s[2];
-            d[1] = s[1];
-            d[2] = s[0];
-            s += 4;
-            d += 3;
-        }
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BGR32_SIMD
+#include <immintrin.h>
+#endif
+
+static void bgr32_to_rgb888_scalar(uint8_t *d, const uint8_t *s, int n) {
+    for (int i = 0; i < n; i++) {
+        d[0] = s[2];
+        d[1] = s[1];
+        d[2] = s[0];
+        s += 4;
+        d += 3;
+    }
+}
+
+#ifdef BGR32_SIMD
+
+__attribute__((target("ssse3"))) static void bgr32_to_rgb888_ssse3(uint8_t *d, const uint8_t *s, int n) {
+    // pack 4 bgrx pixels into the low 12 bytes of a register as rgb
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + 4 * i)), shuffle);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + 4 * i + 16)), shuffle);
+        __m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + 4 * i + 32)), shuffle);
+        __m128i e = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + 4 * i + 48)), shuffle);
+        _mm_storeu_si128((__m128i *)(d + 3 * i), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+        _mm_storeu_si128((__m128i *)(d + 3 * i + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+        _mm_storeu_si128((__m128i *)(d + 3 * i + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(e, 4)));
+    }
+
+    bgr32_to_rgb888_scalar(d + 3 * i, s + 4 * i, n - i);
+}
+
+__attribute__((target("avx2"))) static void bgr32_to_rgb888_avx2(uint8_t *d, const uint8_t *s, int n) {
+    // pshufb works within each 128 bit lane, so pack each lane to 12 bytes and then move
+    // the 6 used dwords next to each other
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                             2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+    int i = 0;
+    // each store writes 32 bytes but only 24 of them are pixels, the rest is overwritten
+    // by the next store, so stop while there are still a few pixels left for the tail
+    for (; i + 11 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + 4 * i));
+        v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, shuffle), compact);
+        _mm256_storeu_si256((__m256i *)(d + 3 * i), v);
+    }
+
+    bgr32_to_rgb888_ssse3(d + 3 * i, s + 4 * i, n - i);
+}
+
+#endif
+
+typedef void (*bgr32_to_rgb888_fn)(uint8_t *d, const uint8_t *s, int n);
+
+static bgr32_to_rgb888_fn select_bgr32_to_rgb888() {
+#ifdef BGR32_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return bgr32_to_rgb888_avx2;
     }
+    if (__builtin_cpu_supports("ssse3")) {
+        return bgr32_to_rgb888_ssse3;
+    }
+#endif
+    return bgr32_to_rgb888_scalar;
+}
+
+void bgr32_to_rgb888(void *dst_rgb888, void *src_bgr32, int w, int h) {
+    // the kernel is picked at runtime since the package is built for the minimum spec processor
+    static const bgr32_to_rgb888_fn convert = select_bgr32_to_rgb888();
+    // both buffers are tightly packed, so the rows can be converted as one run of pixels
+    convert((uint8_t *)dst_rgb888, (const uint8_t *)src_bgr32, w * h);
 }
 
 Game::Game(std::string name) : game_name(name) {
@@ -48,6 +110,7 @@ void Game::parse_options(std::string name, VecOptions opts) {
     opts.consume_bool("use_backgrounds", &options.use_backgrounds);
     opts.consume_bool("center_agent", &options.center_agent);
     opts.consume_bool("use_sequential_levels", &options.use_sequential_levels);
+    opts.consume_bool("cache_static_layer", &options.cache_static_layer);
 
     int dist_mode = EasyMode;
     opts.consume_int("distribution_mode", &dist_mode);
@@ -65,6 +128,23 @@ void Game::parse_options(std::string name, VecOptions opts) {
         fatal("invalid distribution_mode %d\n", options.distribution_mode);
     }
 
+    int render_backend = QtRenderBackend;
+    opts.consume_int("render_backend", &render_backend);
+    if (render_backend != QtRenderBackend && render_backend != SoftwareRenderBackend) {
+        fatal("invalid render_backend %d\n", render_backend);
+    }
+    options.render_backend = static_cast<RenderBackend>(render_backend);
+
+    opts.consume_int("generated_background_size", &options.generated_background_size);
+    if (options.generated_background_size <= 0) {
+        fatal("invalid generated_background_size %d\n", options.generated_background_size);
+    }
+
+    opts.consume_int("entity_hash_min_size", &options.entity_hash_min_size);
+    if (options.entity_hash_min_size < -1) {
+        fatal("invalid entity_hash_min_size %d\n", options.entity_hash_min_size);
+    }
+
     // coinrun_old
     opts.consume_int("plain_assets", &options.plain_assets);
     opts.consume_int("physics_mode", &options.physics_mode);
@@ -81,16 +161,20 @@ void Game::render_to_buf(void *dst, int w, int h, bool antialias) {
     // Qt focuses on RGB32 performance:
     // https://doc.qt.io/qt-5/qpainter.html#performance
     // so render to an RGB32 buffer and then convert it rather than render to RGB888 directly
-    QImage img((uchar *)dst, w, h, w * 4, QImage::Format_RGB32);
-    QPainter p(&img);
+    QRect rect = QRect(0, 0, w, h);
 
-    if (antialias) {
-        p.setRenderHint(QPainter::Antialiasing, true);
-        p.setRenderHint(QPainter::SmoothPixmapTransform, true);
+    // the software renderer only does aliased drawing
+    if (options.render_backend == SoftwareRenderBackend && !antialias) {
+        if (!software_renderer || software_renderer->bits() != dst || software_renderer->width() != w || software_renderer->height() != h) {
+            software_renderer.emplace((uint32_t *)(dst), w, h);
+        }
+        game_draw(*software_renderer, rect);
+        return;
     }
 
-    QRect rect = QRect(0, 0, w, h);
-    game_draw(p, rect);
+    QImage img((uchar *)dst, w, h, w * 4, QImage::Format_RGB32);
+    QtRenderer r(&img, antialias);
+    game_draw(r, rect);
 }
 
 void Game::reset() {
@@ -121,6 +205,10 @@ void Game::reset() {
 }
 
 void Game::step() {
+#ifdef PROCGEN_COUNT_ALLOCATIONS
+    int64_t allocations_before = thread_allocations();
+#endif
+
     cur_time += 1;
     bool will_force_reset = false;
 
@@ -136,6 +224,12 @@ void Game::step() {
 
     step_data.done = step_data.done || will_force_reset || (cur_time >= timeout);
     total_reward += step_data.reward;
+    episode_return += step_data.reward;
+    episode_length += 1;
+
+    if (step_data.level_complete) {
+        levels_solved += 1;
+    }
 
     if (step_data.reward != 0) {
         last_reward_timer = 10;
@@ -154,7 +248,20 @@ void Game::step() {
 
     episode_done = step_data.done;
 
+    if (episode_done) {
+        episodes_completed += 1;
+    }
+
     observe();
+
+    if (episode_done) {
+        episode_return = 0;
+        episode_length = 0;
+    }
+
+#ifdef PROCGEN_COUNT_ALLOCATIONS
+    step_allocations = thread_allocations() - allocations_before;
+#endif
 }
 
 void Game::observe() {
@@ -162,14 +269,22 @@ void Game::observe() {
     bgr32_to_rgb888(obs_bufs[0], render_buf, RES_W, RES_H);
     *reward_ptr = step_data.reward;
     *first_ptr = (uint8_t)step_data.done;
-    *(int32_t *)(info_bufs[info_name_to_offset.at("prev_level_seed")]) = (int32_t)(prev_level_seed);
-    *(uint8_t *)(info_bufs[info_name_to_offset.at("prev_level_complete")]) = (uint8_t)(step_data.level_complete);
-    *(int32_t *)(info_bufs[info_name_to_offset.at("level_seed")]) = (int32_t)(current_level_seed);
+    write_info(PREV_LEVEL_SEED_INFO, (int32_t)(prev_level_seed));
+    write_info(PREV_LEVEL_COMPLETE_INFO, (uint8_t)(step_data.level_complete));
+    write_info(LEVEL_SEED_INFO, (int32_t)(current_level_seed));
+    write_info(EPISODE_RETURN_INFO, episode_return);
+    write_info(EPISODE_LENGTH_INFO, (int32_t)(episode_length));
+    write_info(EPISODES_COMPLETED_INFO, (int32_t)(episodes_completed));
+    write_info(LEVELS_SOLVED_INFO, (int32_t)(levels_solved));
 }
 
 void Game::game_init() {
 }
 
+int64_t Game::get_entity_allocations() {
+    return 0;
+}
+
 void Game::serialize(WriteBuffer *b) {
     b->write_int(SERIALIZE_VERSION);
     
@@ -226,7 +341,7 @@ void Game::serialize(WriteBuffer *b) {
     // if deserialized into another game object
     // int32_t *action_ptr;
     // std::vector<void *> obs_bufs;
-    // std::vector<void *> info_bufs;
+    // void *info_slots[NUM_INFO_SLOTS];
     // float *reward_ptr = nullptr;
     // uint8_t *first_ptr = nullptr;
 }
@@ -8,6 +8,7 @@ Base class used for all games, all games must inherit from this
 
 #include <QtGui/QPainter>
 #include <memory>
+#include <optional>
 #include <functional>
 #include <vector>
 #include <string>
@@ -17,6 +18,8 @@ Base class used for all games, all games must inherit from this
 #include "object-ids.h"
 #include "game-registry.h"
 #include "buffer.h"
+#include "renderer.h"
+#include "info-slots.h"
 
 // We want all games to have same observation space. So all these
 // constants here related to observation space are constants forever.
@@ -51,7 +54,13 @@ struct GameOptions {
     bool center_agent = false;
     int debug_mode = 0;
     DistributionMode distribution_mode = HardMode;
+    RenderBackend render_backend = QtRenderBackend;
+    int generated_background_size = 500;
     bool use_sequential_levels = false;
+    bool cache_static_layer = true;
+    // entities are checked for collisions through an entity hash when there are more than this many,
+    // -1 never uses it
+    int entity_hash_min_size = 24;
 
     // coinrun_old
     bool use_easy_jump = false;
@@ -65,7 +74,6 @@ struct GameOptions {
 class Game {
   public:
     const std::string game_name;
-    std::map<std::string, int> info_name_to_offset;
 
     GameOptions options;
 
@@ -99,12 +107,19 @@ class Game {
 
     int cur_time = 0;
 
+    // heap allocations made by procgen code during the last step(), only counted in builds
+    // configured with PROCGEN_COUNT_ALLOCATIONS
+    int64_t step_allocations = 0;
+
     bool is_waiting_for_step = false;
+    // finished stepping but not yet handed back by VecGame::recv_ready()
+    bool is_ready = false;
 
     // pointers to buffers
     int32_t *action_ptr;
     std::vector<void *> obs_bufs;
-    std::vector<void *> info_bufs;
+    // where each info slot is written, nullptr for slots that are not enabled
+    void *info_slots[NUM_INFO_SLOTS] = {};
     float *reward_ptr = nullptr;
     uint8_t *first_ptr = nullptr;
 
@@ -115,15 +130,40 @@ class Game {
     void parse_options(std::string name, VecOptions opt_vec);
 
     virtual ~Game() = 0;
+    template <typename T>
+    T *info_ptr(InfoSlot<T> slot) {
+        return (T *)(info_slots[slot.index]);
+    }
+
+    template <typename T>
+    void write_info(InfoSlot<T> slot, T value) {
+        T *ptr = info_ptr(slot);
+        if (ptr != nullptr) {
+            *ptr = value;
+        }
+    }
+
     virtual void observe();
     virtual void game_init() = 0;
     virtual void game_reset() = 0;
     virtual void game_step() = 0;
-    virtual void game_draw(QPainter &p, const QRect &rect) = 0;
+    virtual void game_draw(Renderer &r, const QRect &rect) = 0;
     virtual void serialize(WriteBuffer *b);
     virtual void deserialize(ReadBuffer *b);
+    // number of entities allocated on the heap since the game was created
+    virtual int64_t get_entity_allocations();
 
   private:
     int reset_count = 0;
     float total_reward = 0.0f;
+
+    // unlike total_reward and cur_time these carry over the new levels of use_sequential_levels,
+    // and only start over once an episode is done
+    float episode_return = 0.0f;
+    int episode_length = 0;
+    int episodes_completed = 0;
+    int levels_solved = 0;
+
+    // kept from frame to frame, so the painter it draws rotated images with is only set up once
+    std::optional<SoftwareRenderer> software_renderer;
 };
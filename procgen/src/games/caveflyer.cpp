@@ -33,6 +33,10 @@ class CaveFlyerGame : public BasicAbstractGame {
         main_bg_images_ptr = &space_backgrounds;
     }
 
+    bool has_static_grid() override {
+        return true;
+    }
+
     void asset_for_type(int type, std::vector<std::string> &names) override {
         if (type == GOAL) {
             names.push_back("misc_assets/ufoGreen2.png");
@@ -27,6 +27,9 @@ class ChaserGame : public BasicAbstractGame {
     std::shared_ptr<MazeGen> maze_gen;
     std::vector<int> free_cells;
     std::vector<bool> is_space_vec;
+    // scratch buffers for choosing where enemies go next
+    std::vector<int> adj_elems;
+    std::vector<int> space_neighbors;
     int eat_timeout = 0;
     int egg_timeout = 0;
     int eat_time = 0;
@@ -51,6 +54,10 @@ class ChaserGame : public BasicAbstractGame {
         main_bg_images_ptr = &topdown_simple_backgrounds;
     }
 
+    bool has_static_grid() override {
+        return true;
+    }
+
     void asset_for_type(int type, std::vector<std::string> &names) override {
         if (type == PLAYER) {
             names.push_back("misc_assets/enemyFloating_1b.png");
@@ -108,11 +115,11 @@ class ChaserGame : public BasicAbstractGame {
         return BasicAbstractGame::image_for_type(type);
     }
 
-    void draw_grid_obj(QPainter &p, const QRectF &rect, int type, int theme) override {
+    void draw_grid_obj(Renderer &r, const QRectF &rect, int type, int theme) override {
         if (type == ORB) {
-            p.fillRect(QRectF(rect.x() + rect.width() * (1 - ORB_DIM) / 2, rect.y() + rect.height() * (1 - ORB_DIM) / 2, rect.width() * ORB_DIM, rect.height() * ORB_DIM), QColor(0, 255, 0));
+            r.fill_rect(QRectF(rect.x() + rect.width() * (1 - ORB_DIM) / 2, rect.y() + rect.height() * (1 - ORB_DIM) / 2, rect.width() * ORB_DIM, rect.height() * ORB_DIM), QColor(0, 255, 0));
         } else {
-            BasicAbstractGame::draw_grid_obj(p, rect, type, theme);
+            BasicAbstractGame::draw_grid_obj(r, rect, type, theme);
         }
     }
 
@@ -215,7 +222,7 @@ class ChaserGame : public BasicAbstractGame {
             }
         }
 
-        free_cells = get_cells_with_type(SPACE);
+        get_cells_with_type(SPACE, free_cells);
         std::vector<int> selected_idxs = rand_gen.simple_choose((int)(free_cells.size()), 1 + total_enemies);
 
         int start_idx = selected_idxs[0];
@@ -328,8 +335,8 @@ class ChaserGame : public BasicAbstractGame {
                 bool be_agressive = step_rand_int % 2 == 0;
 
                 if ((ent->vx == 0 && ent->vy == 0) || is_at_junction) {
-                    std::vector<int> adj_elems;
-                    std::vector<int> space_neighbors;
+                    adj_elems.clear();
+                    space_neighbors.clear();
                     int prev_idx = to_grid_idx(x - sign(ent->vx), y - sign(ent->vy));
                     get_adjacent(enemy_idx, adj_elems);
 
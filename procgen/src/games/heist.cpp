@@ -37,6 +37,10 @@ class HeistGame : public BasicAbstractGame {
         main_bg_images_ptr = &topdown_backgrounds;
     }
 
+    bool has_static_grid() override {
+        return true;
+    }
+
     bool should_preserve_type_themes(int type) override {
         return type == KEY || type == LOCKED_DOOR;
     }
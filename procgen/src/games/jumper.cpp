@@ -47,6 +47,10 @@ class Jumper : public BasicAbstractGame {
         main_bg_images_ptr = &platform_backgrounds;
     }
 
+    bool has_static_grid() override {
+        return true;
+    }
+
     void asset_for_type(int type, std::vector<std::string> &names) override {
         if (type == PLAYER) {
             names.push_back("misc_assets/bunny2_ready.png");
@@ -134,23 +138,22 @@ class Jumper : public BasicAbstractGame {
         return BasicAbstractGame::image_for_type(type);
     }
 
-    void draw_compass(QPainter &p, const QRect &rect) {
+    void draw_compass(Renderer &r, const QRect &rect) {
         QRectF compass_rect = get_abs_rect(view_dim - compass_dim - .25, .25, compass_dim, compass_dim);
         QColor clock_color = QColor(168, 166, 158);
 
-        set_pen_brush_color(p, clock_color);
-        p.drawEllipse(compass_rect);
+        r.draw_ellipse(compass_rect, clock_color, 1);
         QColor highlight_color = QColor(252, 186, 3);
 
-        float pen_thickness = rect.width() / (256.0 / compass_dim);
+        int pen_thickness = rect.width() / (256.0 / compass_dim);
 
-        set_pen_brush_color(p, highlight_color, pen_thickness);
         float cx = compass_rect.center().x();
         float cy = compass_rect.center().y();
         float cr = compass_rect.width() / 2 * .95;
         float theta = get_theta(agent, goal);
 
-        p.drawLine(cx, cy, cx + cr * cos(theta), cy - cr * sin(theta));
+        // the line is drawn between integer coordinates
+        r.draw_line(int(cx), int(cy), int(cx + cr * cos(theta)), int(cy - cr * sin(theta)), highlight_color, pen_thickness);
 
         float dist = get_distance(agent, goal);
         float dist_pct = dist / (main_width * sqrt(2));
@@ -158,21 +161,19 @@ class Jumper : public BasicAbstractGame {
         float bar_thickness = compass_dim / 8;
 
         QRectF dist_rect = get_abs_rect(view_dim - compass_dim - .25, .25 + compass_dim, compass_dim * dist_pct, bar_thickness);
-        p.fillRect(dist_rect, highlight_color);
+        r.fill_rect(dist_rect, highlight_color);
 
         if (jump_delta < 0 && !has_support) {
             QRectF r1 = get_object_rect(agent);
-            p.setBrush(QColor(255, 255, 255, 120));
-            p.setPen(Qt::NoPen);
-            p.drawEllipse(QRect(r1.x(), r1.y() + r1.height() * (5.0 / 6), r1.width(), r1.height() / 3));
+            r.draw_ellipse(QRect(r1.x(), r1.y() + r1.height() * (5.0 / 6), r1.width(), r1.height() / 3), QColor(255, 255, 255, 120));
         }
     }
 
-    void game_draw(QPainter &p, const QRect &rect) override {
-        BasicAbstractGame::game_draw(p, rect);
+    void game_draw(Renderer &r, const QRect &rect) override {
+        BasicAbstractGame::game_draw(r, rect);
 
         if (options.distribution_mode != MemoryMode) {
-            draw_compass(p, rect);
+            draw_compass(r, rect);
         }
     }
 
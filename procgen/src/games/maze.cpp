@@ -27,6 +27,10 @@ class MazeGame : public BasicAbstractGame {
         main_bg_images_ptr = &topdown_backgrounds;
     }
 
+    bool has_static_grid() override {
+        return true;
+    }
+
     void asset_for_type(int type, std::vector<std::string> &names) override {
         if (type == WALL_OBJ) {
             names.push_back("kenney/Ground/Sand/sandCenter.png");
@@ -163,15 +163,15 @@ class Ninja : public BasicAbstractGame {
         return BasicAbstractGame::image_for_type(type);
     }
 
-    void game_draw(QPainter &p, const QRect &rect) override {
-        BasicAbstractGame::game_draw(p, rect);
+    void game_draw(Renderer &r, const QRect &rect) override {
+        BasicAbstractGame::game_draw(r, rect);
 
         QColor charge_color = QColor(66, 245, 135);
 
         float bar_height = 3 * jump_charge;
 
         QRectF dist_rect2 = get_abs_rect(.25, visibility - .5 - bar_height, .5, bar_height);
-        p.fillRect(dist_rect2, charge_color);
+        r.fill_rect(dist_rect2, charge_color);
     }
 
     void fill_block_top(int x, int y, int dx, int dy, char fill, char top) {
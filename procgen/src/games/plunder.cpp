@@ -46,6 +46,10 @@ class PlunderGame : public BasicAbstractGame {
         main_bg_images_ptr = &water_surface_backgrounds;
     }
 
+    bool has_static_grid() override {
+        return true;
+    }
+
     void asset_for_type(int type, std::vector<std::string> &names) override {
         if (type == SHIP) {
             names.push_back("misc_assets/ship_1.png");
@@ -63,17 +67,17 @@ class PlunderGame : public BasicAbstractGame {
         }
     }
 
-    void game_draw(QPainter &p, const QRect &rect) override {
-        BasicAbstractGame::game_draw(p, rect);
+    void game_draw(Renderer &r, const QRect &rect) override {
+        BasicAbstractGame::game_draw(r, rect);
 
         QColor juice_color = QColor(66, 245, 135);
         QColor progress_color = QColor(245, 66, 144);
 
         QRectF dist_rect1 = get_abs_rect(.25, .25, main_width * juice_left, .5);
-        p.fillRect(dist_rect1, juice_color);
+        r.fill_rect(dist_rect1, juice_color);
 
         QRectF dist_rect2 = get_abs_rect(.25, .75, main_width * (targets_hit * 1.0 / target_quota), .5);
-        p.fillRect(dist_rect2, progress_color);
+        r.fill_rect(dist_rect2, progress_color);
     }
 
     bool is_target(int theme_num) {
@@ -202,7 +206,7 @@ class PlunderGame : public BasicAbstractGame {
             float ent_y = (lane * .11 + .4) * (main_height / 2 - ent_r) + main_height / 2;
             float moves_right = lane_directions[lane];
             float ent_vx = lane_vels[lane] * (moves_right ? 1 : -1);
-            auto ent = std::make_shared<Entity>(0, ent_y, ent_vx, 0, ent_r, SHIP);
+            auto ent = entity_pool.make(0, ent_y, ent_vx, 0, ent_r, SHIP);
             ent->image_type = SHIP;
             ent->image_theme = image_permutation[rand_gen.randn(num_current_ship_types)];
             match_aspect_ratio(ent);
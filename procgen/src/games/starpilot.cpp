@@ -104,12 +104,12 @@ class StarPilotGame : public BasicAbstractGame {
         }
     }
 
-    void game_draw(QPainter &p, const QRect &rect) override {
+    void game_draw(Renderer &r, const QRect &rect) override {
         float scale = rect.height() / main_height;
 
         QColor bg_color = QColor(0, 0, 0);
 
-        p.fillRect(rect, bg_color);
+        r.fill_rect(rect, bg_color);
 
         if (options.use_backgrounds) {
             float bg_k = 3;
@@ -117,10 +117,10 @@ class StarPilotGame : public BasicAbstractGame {
             float x_off = -t * scale * hp_slow_v * 2 / char_dim;
 
             QRectF r_bg = QRectF(x_off, -rect.height() * (bg_k - 1) / 2, rect.height() * bg_k * BG_RATIO, rect.height() * bg_k);
-            tile_image(p, main_bg_images_ptr->at(background_index).get(), r_bg, 1);
+            tile_image(r, main_bg_images_ptr->at(background_index).get(), r_bg, 1);
         }
 
-        draw_foreground(p, rect);
+        draw_foreground(r, rect);
     }
 
     void handle_agent_collision(const std::shared_ptr<Entity> &obj) override {
@@ -301,7 +301,7 @@ class StarPilotGame : public BasicAbstractGame {
                     vx *= -1;
                 }
 
-                auto spawner = std::make_shared<Entity>(x_pos, y_pos, vx, vy, r, type);
+                auto spawner = entity_pool.make(x_pos, y_pos, vx, vy, r, type);
                 spawner->fire_time = fire_time;
                 spawner->spawn_time = spawn_time;
                 spawner->health = health;
@@ -333,7 +333,8 @@ class StarPilotGame : public BasicAbstractGame {
 
         init_hps();
 
-        spawners.clear();
+        // spawners that never entered the last level go back to the pool along with its entities
+        entity_pool.release_all(spawners);
 
         add_spawners();
 
@@ -385,7 +386,7 @@ class StarPilotGame : public BasicAbstractGame {
                 b_vx = b_vx * bv_scale;
                 b_vy = b_vy * bv_scale;
 
-                std::shared_ptr<Entity> new_bullet(new Entity(m->x, m->y, b_vx, b_vy, bullet_r, bullet_type));
+                auto new_bullet = entity_pool.make(m->x, m->y, b_vx, b_vy, bullet_r, bullet_type);
                 new_bullet->face_direction(b_vx, b_vy, -1 * PI / 2);
                 entities.push_back(new_bullet);
             }
@@ -413,7 +414,7 @@ class StarPilotGame : public BasicAbstractGame {
             float vy = sin(theta) * v_scale;
             float x_off = agent->rx * cos(theta);
 
-            auto bullet = std::make_shared<Entity>(agent->x + x_off, agent->y, vx, vy, bullet_r, BULLET_PLAYER);
+            auto bullet = entity_pool.make(agent->x + x_off, agent->y, vx, vy, bullet_r, BULLET_PLAYER);
             bullet->collides_with_entities = true;
             bullet->face_direction(vx, vy);
             bullet->rotation -= PI / 2;
@@ -421,7 +422,7 @@ class StarPilotGame : public BasicAbstractGame {
         }
 
         if (cur_time == SHOOTER_WIN_TIME) {
-            auto finish = std::make_shared<Entity>(main_width, main_height / 2, -1 * hp_slow_v * V_SCALE, 0, 2, main_height / 2, FINISH_LINE);
+            auto finish = entity_pool.make(main_width, main_height / 2, -1 * hp_slow_v * V_SCALE, 0, 2, main_height / 2, FINISH_LINE);
             choose_random_theme(finish);
             match_aspect_ratio(finish, false);
             finish->x = main_width + finish->rx;
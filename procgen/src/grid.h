@@ -7,15 +7,49 @@ Simple utility class for managing a grid of objects
 */
 
 #include <vector>
+#include <algorithm>
 #include "cpp-utils.h"
 #include "buffer.h"
 
+// inclusive bounding box of grid cells, empty when x1 > x2
+struct DirtyRect {
+    int x1 = 0;
+    int y1 = 0;
+    int x2 = -1;
+    int y2 = -1;
+
+    bool is_empty() const {
+        return x1 > x2;
+    }
+
+    void add(int x, int y) {
+        if (is_empty()) {
+            x1 = x2 = x;
+            y1 = y2 = y;
+        } else {
+            x1 = std::min(x1, x);
+            x2 = std::max(x2, x);
+            y1 = std::min(y1, y);
+            y2 = std::max(y2, y);
+        }
+    }
+
+    void add(const DirtyRect &other) {
+        if (!other.is_empty()) {
+            add(other.x1, other.y1);
+            add(other.x2, other.y2);
+        }
+    }
+};
+
 template <typename T>
 class Grid {
   public:
     int w;
     int h;
     std::vector<T> data;
+    // cells set since the last call to take_dirty(), for redrawing only the part of the grid that changed
+    DirtyRect dirty;
 
     Grid() {
         w = 0;
@@ -27,6 +61,7 @@ class Grid {
         h = height;
         data.clear();
         data.resize(width * height);
+        mark_all_dirty();
     }
 
     bool contains(int x, int y) const {
@@ -59,11 +94,27 @@ class Grid {
     void set(int x, int y, T v) {
         fassert(contains(x, y));
         data[y * w + x] = v;
+        dirty.add(x, y);
     };
 
     void set_index(int index, T v) {
         fassert(index < w * h);
         data[index] = v;
+        dirty.add(index % w, index / w);
+    };
+
+    DirtyRect take_dirty() {
+        DirtyRect result = dirty;
+        dirty = DirtyRect();
+        return result;
+    };
+
+    void mark_all_dirty() {
+        dirty = DirtyRect();
+        if (w > 0 && h > 0) {
+            dirty.add(0, 0);
+            dirty.add(w - 1, h - 1);
+        }
     };
 
     void serialize(WriteBuffer *b) {
@@ -76,5 +127,6 @@ class Grid {
         w = b->read_int();
         h = b->read_int();
         data = b->read_vector_int();
+        mark_all_dirty();
     };
 };
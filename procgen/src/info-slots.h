@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+
+The info tensors that games write on every step
+
+Each slot has a fixed index and element type, so a game writes one with a plain store through a
+pointer that is resolved whenever its buffers change, instead of looking it up by name. VecGame
+declares the info tensor of each enabled slot, and adding a channel means adding a slot here and
+declaring its tensor there.
+
+*/
+
+#include <cstdint>
+
+enum InfoSlotIndex {
+    PREV_LEVEL_SEED_SLOT = 0,
+    PREV_LEVEL_COMPLETE_SLOT,
+    LEVEL_SEED_SLOT,
+    RENDER_RGB_SLOT,
+    EPISODE_RETURN_SLOT,
+    EPISODE_LENGTH_SLOT,
+    EPISODES_COMPLETED_SLOT,
+    LEVELS_SOLVED_SLOT,
+    NUM_INFO_SLOTS,
+};
+
+// names of the info tensors, indexed by InfoSlotIndex
+const char *const INFO_SLOT_NAMES[NUM_INFO_SLOTS] = {
+    "prev_level_seed",
+    "prev_level_complete",
+    "level_seed",
+    "rgb",
+    "episode_return",
+    "episode_length",
+    "episodes_completed",
+    "levels_solved",
+};
+
+// a slot along with the type of its elements
+template <typename T>
+struct InfoSlot {
+    InfoSlotIndex index;
+};
+
+const InfoSlot<int32_t> PREV_LEVEL_SEED_INFO = {PREV_LEVEL_SEED_SLOT};
+const InfoSlot<uint8_t> PREV_LEVEL_COMPLETE_INFO = {PREV_LEVEL_COMPLETE_SLOT};
+const InfoSlot<int32_t> LEVEL_SEED_INFO = {LEVEL_SEED_SLOT};
+// RENDER_RES x RENDER_RES x 3 pixels, only enabled with render_human
+const InfoSlot<uint8_t> RENDER_RGB_INFO = {RENDER_RGB_SLOT};
+
+// only enabled with episode_stats, the return and length are of the episode so far, so on the step
+// that ends an episode they hold its totals
+const InfoSlot<float> EPISODE_RETURN_INFO = {EPISODE_RETURN_SLOT};
+const InfoSlot<int32_t> EPISODE_LENGTH_INFO = {EPISODE_LENGTH_SLOT};
+const InfoSlot<int32_t> EPISODES_COMPLETED_INFO = {EPISODES_COMPLETED_SLOT};
+const InfoSlot<int32_t> LEVELS_SOLVED_INFO = {LEVELS_SOLVED_SLOT};
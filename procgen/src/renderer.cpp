@@ -0,0 +1,334 @@
+#include "renderer.h"
+#include "cpp-utils.h"
+#include "sprite-cache.h"
+#include <algorithm>
+#include <cmath>
+
+Renderer::Renderer(uint32_t *_buf, int _w, int _h)
+    : buf(_buf), w(_w), h(_h) {
+}
+
+Renderer::~Renderer() {
+}
+
+uint32_t *Renderer::bits() const {
+    return buf;
+}
+
+int Renderer::width() const {
+    return w;
+}
+
+int Renderer::height() const {
+    return h;
+}
+
+QtRenderer::QtRenderer(QImage *image, bool _antialias)
+    : Renderer((uint32_t *)(image->bits()), image->width(), image->height()), p(image), antialias(_antialias) {
+    if (antialias) {
+        p.setRenderHint(QPainter::Antialiasing, true);
+        p.setRenderHint(QPainter::SmoothPixmapTransform, true);
+    }
+}
+
+void QtRenderer::fill_rect(const QRectF &rect, const QColor &color) {
+    p.fillRect(rect, color);
+}
+
+void QtRenderer::draw_image(const QRectF &rect, const QImage &image, float rotation, float alpha) {
+    // opacity and the transform are set back by hand, saving the painter would allocate its state
+    if (alpha != 1) {
+        p.setOpacity(alpha);
+    }
+
+    if (rotation == 0) {
+        if (antialias && rect.width() <= image.width() && rect.height() <= image.height()) {
+            draw_scaled_sprite(rect, image);
+        } else {
+            p.drawImage(rect, image);
+        }
+    } else {
+        QTransform transform;
+        transform.translate(rect.x() + rect.width() / 2, rect.y() + rect.height() / 2);
+        transform.rotate(rotation * 180 / PI);
+        p.setTransform(transform);
+        p.drawImage(QRectF(-rect.width() / 2, -rect.height() / 2, rect.width(), rect.height()), image);
+        p.resetTransform();
+    }
+
+    if (alpha != 1) {
+        p.setOpacity(1);
+    }
+}
+
+void QtRenderer::draw_scaled_sprite(const QRectF &rect, const QImage &image) {
+    // snap to whole pixels so that the cached sprite is drawn without any further resampling
+    int x1 = qRound(rect.left());
+    int x2 = qRound(rect.right());
+    int y1 = qRound(rect.top());
+    int y2 = qRound(rect.bottom());
+
+    if (x2 <= x1 || y2 <= y1) {
+        return;
+    }
+
+    p.drawImage(QPoint(x1, y1), *get_scaled_sprite(image, x2 - x1, y2 - y1));
+}
+
+void QtRenderer::draw_ellipse(const QRectF &rect, const QColor &color, float outline) {
+    p.setBrush(get_brush(color));
+    if (outline > 0) {
+        p.setPen(get_pen(color, outline));
+    } else {
+        p.setPen(Qt::NoPen);
+    }
+    p.drawEllipse(rect);
+}
+
+void QtRenderer::draw_line(float x1, float y1, float x2, float y2, const QColor &color, float width) {
+    p.setPen(get_pen(color, width));
+    p.drawLine(QPointF(x1, y1), QPointF(x2, y2));
+}
+
+const QBrush &QtRenderer::get_brush(const QColor &color) {
+    for (const auto &brush : brushes) {
+        if (brush.color() == color) {
+            return brush;
+        }
+    }
+    brushes.emplace_back(color);
+    return brushes.back();
+}
+
+const QPen &QtRenderer::get_pen(const QColor &color, float width) {
+    for (const auto &pen : pens) {
+        if (pen.color() == color && pen.widthF() == width) {
+            return pen;
+        }
+    }
+    pens.emplace_back(color, width);
+    return pens.back();
+}
+
+// the software renderer follows the rounding and blending of Qt's raster engine for aliased rect fills
+// and unrotated images, so its frames match QtRenderer's exactly, see test_render_backend in env_test.py
+
+static inline int round_coord(double d) {
+    return (int)(std::floor(d + 0.5));
+}
+
+// multiply each channel by a / 255
+static inline uint32_t byte_mul(uint32_t x, uint32_t a) {
+    uint64_t t = ((uint64_t)(x) | ((uint64_t)(x) << 24)) & 0x00ff00ff00ff00ffull;
+    t *= a;
+    t = (t + ((t >> 8) & 0x00ff00ff00ff00ffull) + 0x0080008000800080ull) >> 8;
+    t &= 0x00ff00ff00ff00ffull;
+    return (uint32_t)(t) | (uint32_t)(t >> 24);
+}
+
+static inline uint32_t premultiply(uint32_t x) {
+    uint32_t a = x >> 24;
+    return byte_mul(x & 0xffffff, a) | (a << 24);
+}
+
+// source over with a premultiplied source
+static inline uint32_t blend_over(uint32_t dst, uint32_t src) {
+    if (src >= 0xff000000) {
+        return src;
+    }
+    return src + byte_mul(dst, 255 - (src >> 24));
+}
+
+// x * a / 255 + y * b / 255 with a single rounding per channel
+static inline uint32_t interpolate_255(uint32_t x, uint32_t a, uint32_t y, uint32_t b) {
+    uint32_t t = (x & 0xff00ff) * a + (y & 0xff00ff) * b;
+    t = (t + ((t >> 8) & 0xff00ff) + 0x800080) >> 8;
+    t &= 0xff00ff;
+    x = ((x >> 8) & 0xff00ff) * a + ((y >> 8) & 0xff00ff) * b;
+    x = (x + ((x >> 8) & 0xff00ff) + 0x800080);
+    x &= 0xff00ff00;
+    return x | t;
+}
+
+// blend a premultiplied image pixel with the painter opacity applied, Qt blends opaque images with
+// an opacity by interpolating instead of scaling the source first
+static inline uint32_t blend_image_pixel(uint32_t dst, uint32_t src, bool opaque_image, int const_alpha) {
+    if (const_alpha == 255) {
+        return blend_over(dst, src);
+    } else if (opaque_image) {
+        return interpolate_255(src, const_alpha, dst, 255 - const_alpha);
+    }
+    return blend_over(dst, byte_mul(src, const_alpha));
+}
+
+static inline uint32_t fetch_pixel(const uchar *line, int x, bool opaque_image) {
+    uint32_t pixel = ((const uint32_t *)(line))[x];
+    return opaque_image ? pixel | 0xff000000 : pixel;
+}
+
+// Qt draws unrotated images with its scaled blit, which scale_image reproduces, only for these formats
+// and for rects within its fixed point range, a single pixel image is drawn as a rect fill instead
+static bool uses_scaled_blit(const QRectF &rect, const QImage &image) {
+    QImage::Format format = image.format();
+    if (format != QImage::Format_RGB32 && format != QImage::Format_ARGB32_Premultiplied) {
+        return false;
+    }
+    if (image.width() == 1 && image.height() == 1) {
+        return false;
+    }
+    const double limit = 0x7fff;
+    return std::abs(rect.width()) <= limit && std::abs(rect.height()) <= limit && rect.left() >= -limit && rect.top() >= -limit && rect.right() <= limit && rect.bottom() <= limit;
+}
+
+// painter opacity is stored as a fraction of 256 and scaled to 255 when blending
+static inline int to_const_alpha(float alpha) {
+    return ((int)(alpha * 256) * 255) >> 8;
+}
+
+SoftwareRenderer::SoftwareRenderer(uint32_t *_buf, int _w, int _h)
+    : Renderer(_buf, _w, _h) {
+}
+
+void SoftwareRenderer::blend_span(int y, int x1, int x2, uint32_t color) {
+    uint32_t *dst = buf + y * w;
+    if (color >= 0xff000000) {
+        for (int x = x1; x < x2; x++) {
+            dst[x] = color;
+        }
+    } else if (color != 0) {
+        uint32_t ialpha = 255 - (color >> 24);
+        for (int x = x1; x < x2; x++) {
+            dst[x] = color + byte_mul(dst[x], ialpha);
+        }
+    }
+}
+
+void SoftwareRenderer::fill_rect(const QRectF &rect, const QColor &color) {
+    int x1 = round_coord(rect.left());
+    int x2 = round_coord(rect.right());
+    int y1 = round_coord(rect.top());
+    int y2 = round_coord(rect.bottom());
+
+    if (x2 < x1)
+        std::swap(x1, x2);
+    if (y2 < y1)
+        std::swap(y1, y2);
+
+    x1 = std::max(x1, 0);
+    x2 = std::min(x2, w);
+    y1 = std::max(y1, 0);
+    y2 = std::min(y2, h);
+
+    uint32_t c = premultiply(color.rgba());
+
+    for (int y = y1; y < y2; y++) {
+        blend_span(y, x1, x2, c);
+    }
+}
+
+void SoftwareRenderer::draw_image(const QRectF &rect, const QImage &image, float rotation, float alpha) {
+    if (image.width() == 0 || image.height() == 0) {
+        return;
+    }
+
+    if (rotation != 0 || !uses_scaled_blit(rect, image)) {
+        get_qt_renderer()->draw_image(rect, image, rotation, alpha);
+        return;
+    }
+
+    int const_alpha = to_const_alpha(alpha);
+    if (const_alpha == 0) {
+        return;
+    }
+
+    scale_image(rect, image, const_alpha);
+}
+
+void SoftwareRenderer::scale_image(const QRectF &rect, const QImage &image, int const_alpha) {
+    // Qt maps the rect through the painter's transform by its corners, so it scales by right - left,
+    // which can differ from the width in the last bit and move the sampling by a source pixel
+    double left = rect.left();
+    double top = rect.top();
+    double right = left + rect.width();
+    double bottom = top + rect.height();
+
+    // nearest neighbor sampling in 16.16 fixed point, stepping through the image at a constant rate
+    double sx = (right - left) / image.width();
+    double sy = (bottom - top) / image.height();
+    if (sx <= 0 || sy <= 0) {
+        return;
+    }
+
+    int ix = (int)(65536 / sx);
+    int iy = (int)(65536 / sy);
+
+    int tx1 = round_coord(left);
+    int tx2 = round_coord(right);
+    int ty1 = round_coord(top);
+    int ty2 = round_coord(bottom);
+
+    tx1 = std::max(tx1, 0);
+    tx2 = std::min(tx2, w);
+    ty1 = std::max(ty1, 0);
+    ty2 = std::min(ty2, h);
+
+    if (tx1 >= tx2 || ty1 >= ty2) {
+        return;
+    }
+
+    int sw = image.width();
+    int sh = image.height();
+
+    bool opaque_image = image.format() == QImage::Format_RGB32;
+
+    // Qt's SIMD scale, used for images with alpha at full opacity, places the first sample with the
+    // truncated step, the generic one with the exact inverse scale
+    int basex, srcy;
+    if (!opaque_image && const_alpha == 255) {
+        basex = (int)(std::ceil((tx1 + 0.5 - left) * ix)) - 1;
+        srcy = (int)(std::ceil((ty1 + 0.5 - top) * iy)) - 1;
+    } else {
+        basex = (int)(std::ceil((tx1 + 0.5 - left) * (sw / (right - left)) * 65536)) - 1;
+        srcy = (int)(std::ceil((ty1 + 0.5 - top) * (sh / (bottom - top)) * 65536)) - 1;
+    }
+
+    // rounding can take the last column or row one pixel past the image, which Qt leaves undrawn
+    int xend = (basex + ix * (tx2 - tx1 - 1)) >> 16;
+    if (xend < 0 || xend >= sw) {
+        tx2--;
+    }
+    int yend = (srcy + iy * (ty2 - ty1 - 1)) >> 16;
+    if (yend < 0 || yend >= sh) {
+        ty2--;
+    }
+
+    const uchar *bits = image.constBits();
+    int bpl = image.bytesPerLine();
+
+    for (int y = ty1; y < ty2; y++, srcy += iy) {
+        int py = std::min(std::max(srcy >> 16, 0), sh - 1);
+        const uchar *line = bits + py * bpl;
+        uint32_t *dst = buf + y * w;
+        int srcx = basex;
+        for (int x = tx1; x < tx2; x++, srcx += ix) {
+            int px = std::min(std::max(srcx >> 16, 0), sw - 1);
+            dst[x] = blend_image_pixel(dst[x], fetch_pixel(line, px, opaque_image), opaque_image, const_alpha);
+        }
+    }
+}
+
+QtRenderer *SoftwareRenderer::get_qt_renderer() {
+    if (!qt_renderer) {
+        qt_image = QImage((uchar *)(buf), w, h, w * 4, QImage::Format_RGB32);
+        qt_renderer.emplace(&qt_image, false);
+    }
+    return &*qt_renderer;
+}
+
+void SoftwareRenderer::draw_ellipse(const QRectF &rect, const QColor &color, float outline) {
+    get_qt_renderer()->draw_ellipse(rect, color, outline);
+}
+
+void SoftwareRenderer::draw_line(float x1, float y1, float x2, float y2, const QColor &color, float width) {
+    get_qt_renderer()->draw_line(x1, y1, x2, y2, color, width);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+/*
+
+Drawing operations used by the games
+
+QtRenderer draws with a QPainter, SoftwareRenderer draws the rect fills and unrotated images that make
+up most of the aliased 64x64 observations itself, pixel for pixel as QtRenderer would, and skips
+QPainter's per frame overhead
+
+*/
+
+#include <QtGui/QPainter>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// should match RENDER_BACKEND_DICT in env.py
+enum RenderBackend {
+    QtRenderBackend = 0,
+    SoftwareRenderBackend = 1,
+};
+
+class Renderer {
+  public:
+    virtual ~Renderer() = 0;
+
+    // the frame being drawn, w * h pixels in QImage::Format_RGB32
+    uint32_t *bits() const;
+    int width() const;
+    int height() const;
+
+    virtual void fill_rect(const QRectF &rect, const QColor &color) = 0;
+    // scale image to fill rect, rotated by rotation radians around the center of rect
+    virtual void draw_image(const QRectF &rect, const QImage &image, float rotation = 0, float alpha = 1) = 0;
+    // outline is the width of a border in the same color around the ellipse
+    virtual void draw_ellipse(const QRectF &rect, const QColor &color, float outline = 0) = 0;
+    virtual void draw_line(float x1, float y1, float x2, float y2, const QColor &color, float width) = 0;
+
+  protected:
+    Renderer(uint32_t *buf, int w, int h);
+
+    uint32_t *buf;
+    int w;
+    int h;
+};
+
+class QtRenderer : public Renderer {
+  public:
+    QtRenderer(QImage *image, bool antialias);
+
+    void fill_rect(const QRectF &rect, const QColor &color) override;
+    void draw_image(const QRectF &rect, const QImage &image, float rotation = 0, float alpha = 1) override;
+    void draw_ellipse(const QRectF &rect, const QColor &color, float outline = 0) override;
+    void draw_line(float x1, float y1, float x2, float y2, const QColor &color, float width) override;
+
+  private:
+    QPainter p;
+    bool antialias;
+
+    // every brush and pen made allocates, so the ones for colors drawn before are reused, the games
+    // only draw ellipses and lines in a few colors
+    std::vector<QBrush> brushes;
+    std::vector<QPen> pens;
+    const QBrush &get_brush(const QColor &color);
+    const QPen &get_pen(const QColor &color, float width);
+
+    // antialiased frames draw unrotated images that are scaled down from the sprite cache
+    void draw_scaled_sprite(const QRectF &rect, const QImage &image);
+};
+
+class SoftwareRenderer : public Renderer {
+  public:
+    // draws into a w * h buffer of QImage::Format_RGB32 pixels
+    SoftwareRenderer(uint32_t *buf, int w, int h);
+
+    void fill_rect(const QRectF &rect, const QColor &color) override;
+    void draw_image(const QRectF &rect, const QImage &image, float rotation = 0, float alpha = 1) override;
+    void draw_ellipse(const QRectF &rect, const QColor &color, float outline = 0) override;
+    void draw_line(float x1, float y1, float x2, float y2, const QColor &color, float width) override;
+
+  private:
+    // rotated images, ellipses and lines are drawn with qt into the same buffer
+    QImage qt_image;
+    std::optional<QtRenderer> qt_renderer;
+    QtRenderer *get_qt_renderer();
+
+    void blend_span(int y, int x1, int x2, uint32_t color);
+    void scale_image(const QRectF &rect, const QImage &image, int const_alpha);
+};
@@ -1,7 +1,13 @@
 #include "resources.h"
 #include "cpp-utils.h"
+#include "asset-pack.h"
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <map>
 
 std::string global_resource_root;
+std::string global_asset_pack_path;
 
 std::vector<std::shared_ptr<QImage>> topdown_backgrounds;
 std::vector<std::shared_ptr<QImage>> topdown_simple_backgrounds;
@@ -10,11 +16,31 @@ std::vector<std::shared_ptr<QImage>> space_backgrounds;
 std::vector<std::shared_ptr<QImage>> water_backgrounds;
 std::vector<std::shared_ptr<QImage>> water_surface_backgrounds;
 
-std::map<std::string, std::shared_ptr<QImage>> sprites;
+// an image that is decoded the first time it is needed
+struct LazyImage {
+    std::string relpath;
+    QImage::Format format;
+    std::once_flag once;
+    // set once image can be read without going through once
+    std::atomic<bool> loaded{false};
+    // true if the image wasn't in the asset pack
+    bool decoded = false;
+    std::shared_ptr<QImage> image;
+};
 
-std::shared_ptr<QImage> get_asset_ptr(std::string relpath) {
-    return sprites.at(relpath);
-}
+struct BackgroundGroup {
+    std::vector<std::unique_ptr<LazyImage>> images;
+    // groups whose images are also added to this one
+    std::vector<std::vector<std::shared_ptr<QImage>> *> includes;
+    std::once_flag once;
+};
+
+// the keys of both maps are filled in by images_load() and never change after that
+static std::map<std::string, LazyImage> sprites;
+static std::map<std::vector<std::shared_ptr<QImage>> *, BackgroundGroup> background_groups;
+
+static AssetPack asset_pack;
+static bool has_asset_pack = false;
 
 std::shared_ptr<QImage> load_resource_ptr(std::string relpath, QImage::Format format) {
     auto path = global_resource_root + relpath;
@@ -27,6 +53,118 @@ std::shared_ptr<QImage> load_resource_ptr(std::string relpath, QImage::Format fo
     return asset_ptr;
 }
 
+static void load_image(LazyImage *img) {
+    std::call_once(img->once, [img]() {
+        if (has_asset_pack) {
+            img->image = asset_pack.find(global_resource_root, img->relpath, img->format);
+        }
+        if (img->image == nullptr) {
+            img->image = load_resource_ptr(img->relpath, img->format);
+            img->decoded = true;
+        }
+        img->loaded.store(true, std::memory_order_release);
+    });
+}
+
+// load the images that aren't loaded yet on a thread per cpu, since decoding and converting each
+// png takes a while
+static void load_images(const std::vector<LazyImage *> &images) {
+    std::vector<LazyImage *> to_load;
+    for (auto img : images) {
+        if (!img->loaded.load(std::memory_order_acquire)) {
+            to_load.push_back(img);
+        }
+    }
+
+    std::atomic<size_t> next_load(0);
+    auto load_worker = [&]() {
+        size_t i;
+        while ((i = next_load.fetch_add(1)) < to_load.size()) {
+            load_image(to_load[i]);
+        }
+    };
+
+    size_t num_threads = std::min((size_t)(std::max(std::thread::hardware_concurrency(), 1u)), to_load.size());
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < num_threads; t++) {
+        threads.emplace_back(load_worker);
+    }
+    load_worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+std::shared_ptr<QImage> get_asset_ptr(std::string relpath) {
+    LazyImage &img = sprites.at(relpath);
+    load_image(&img);
+    return img.image;
+}
+
+void load_assets(const std::vector<std::string> &relpaths) {
+    std::vector<LazyImage *> images;
+    for (const auto &relpath : relpaths) {
+        images.push_back(&sprites.at(relpath));
+    }
+    load_images(images);
+}
+
+void load_backgrounds(std::vector<std::shared_ptr<QImage>> *backgrounds) {
+    auto it = background_groups.find(backgrounds);
+    if (it == background_groups.end()) {
+        return;
+    }
+
+    BackgroundGroup &group = it->second;
+    std::call_once(group.once, [&]() {
+        std::vector<LazyImage *> images;
+        for (const auto &img : group.images) {
+            images.push_back(img.get());
+        }
+        load_images(images);
+
+        for (const auto &img : group.images) {
+            backgrounds->push_back(img->image);
+        }
+
+        for (auto included : group.includes) {
+            load_backgrounds(included);
+            for (const auto &bg : *included) {
+                backgrounds->push_back(bg);
+            }
+        }
+    });
+}
+
+// with an asset pack, every image is taken from the pack up front, which only maps the file, and
+// if any of them had to be decoded instead, a new pack is written for the next process
+static void load_asset_pack() {
+    AssetPackLock lock(global_asset_pack_path);
+    has_asset_pack = asset_pack.open(global_asset_pack_path);
+
+    std::vector<LazyImage *> images;
+    for (auto &pair : sprites) {
+        images.push_back(&pair.second);
+    }
+    for (auto &pair : background_groups) {
+        for (const auto &img : pair.second.images) {
+            images.push_back(img.get());
+        }
+    }
+    load_images(images);
+
+    bool any_decoded = false;
+    std::vector<AssetPackImage> pack_images;
+    for (auto img : images) {
+        any_decoded = any_decoded || img->decoded;
+        pack_images.push_back(AssetPackImage{img->relpath, img->image});
+    }
+
+    if (any_decoded && !AssetPack::write(global_asset_pack_path, global_resource_root, pack_images)) {
+        fprintf(stderr, "failed to write asset pack %s\n", global_asset_pack_path.c_str());
+    }
+}
+
 void images_load() {
     auto sprite_paths = std::vector<std::string>{
         "kenney/Ground/Planet/planetCorner_left.png",
@@ -811,7 +949,9 @@ void images_load() {
     };
 
     for (const auto& sprite_path : sprite_paths) {
-        sprites[sprite_path] = load_resource_ptr(sprite_path, QImage::Format_ARGB32_Premultiplied);
+        LazyImage &img = sprites[sprite_path];
+        img.relpath = sprite_path;
+        img.format = QImage::Format_ARGB32_Premultiplied;
     }
 
     auto group_to_vector = std::map<std::string, std::vector<std::shared_ptr<QImage>> *>{
@@ -941,14 +1081,19 @@ void images_load() {
     };
 
     for (auto const &pair : group_to_paths) {
-        auto vec = group_to_vector.at(pair.first);
+        BackgroundGroup &group = background_groups[group_to_vector.at(pair.first)];
         for (const auto &path : pair.second) {
-            vec->push_back(load_resource_ptr(path, QImage::Format_RGB32));
+            auto img = std::make_unique<LazyImage>();
+            img->relpath = path;
+            img->format = QImage::Format_RGB32;
+            group.images.push_back(std::move(img));
         }
     }
 
     // also add all space backgrounds as platform backgrounds
-    for (auto bg : space_backgrounds) {
-        platform_backgrounds.push_back(bg);
+    background_groups[&platform_backgrounds].includes.push_back(&space_backgrounds);
+
+    if (global_asset_pack_path != "") {
+        load_asset_pack();
     }
 }
@@ -4,15 +4,27 @@
 
 Load assets stored as individual image files
 
+Images are decoded the first time a game asks for them, so a process only pays for the games it
+creates, and all of the functions here can be called from any thread once images_load() is done
+
 */
 
 #include <QtGui/QPainter>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <vector>
 
 std::shared_ptr<QImage> get_asset_ptr(std::string relpath);
+// decode the images that aren't loaded yet all at once, spread over a few threads
+void load_assets(const std::vector<std::string> &relpaths);
+// fill in one of the background vectors below the first time it is called for that vector
+void load_backgrounds(std::vector<std::shared_ptr<QImage>> *backgrounds);
 
 extern std::string global_resource_root;
+// path of a file of pre-decoded assets that is used if it is up to date and rewritten otherwise,
+// or an empty string to always decode the assets
+extern std::string global_asset_pack_path;
 extern void images_load();
 extern std::vector<std::shared_ptr<QImage>> topdown_backgrounds;
 extern std::vector<std::shared_ptr<QImage>> topdown_simple_backgrounds;
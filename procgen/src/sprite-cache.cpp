@@ -0,0 +1,65 @@
+#include "sprite-cache.h"
+#include <mutex>
+#include <list>
+#include <map>
+#include <tuple>
+
+const size_t MAX_SPRITE_CACHE_BYTES = 64 * 1024 * 1024;
+
+struct SpriteKey {
+    qint64 cache_key;
+    int w;
+    int h;
+
+    bool operator<(const SpriteKey &other) const {
+        return std::tie(cache_key, w, h) < std::tie(other.cache_key, other.w, other.h);
+    }
+};
+
+struct SpriteEntry {
+    SpriteKey key;
+    std::shared_ptr<QImage> image;
+};
+
+static std::mutex sprite_cache_mutex;
+// most recently used entries are at the front
+static std::list<SpriteEntry> lru;
+static std::map<SpriteKey, std::list<SpriteEntry>::iterator> entries;
+static size_t cache_bytes = 0;
+
+std::shared_ptr<QImage> get_scaled_sprite(const QImage &image, int w, int h) {
+    SpriteKey key{image.cacheKey(), w, h};
+
+    {
+        std::lock_guard<std::mutex> lock(sprite_cache_mutex);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->image;
+        }
+    }
+
+    // resample outside the lock, if two threads miss on the same sprite they both do the work
+    // and the second one finds the first one's entry below
+    auto scaled = std::make_shared<QImage>(image.scaled(w, h, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+
+    std::lock_guard<std::mutex> lock(sprite_cache_mutex);
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->image;
+    }
+
+    lru.push_front(SpriteEntry{key, scaled});
+    entries[key] = lru.begin();
+    cache_bytes += scaled->sizeInBytes();
+
+    while (cache_bytes > MAX_SPRITE_CACHE_BYTES && lru.size() > 1) {
+        auto &oldest = lru.back();
+        cache_bytes -= oldest.image->sizeInBytes();
+        entries.erase(oldest.key);
+        lru.pop_back();
+    }
+
+    return scaled;
+}
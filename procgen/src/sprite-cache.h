@@ -0,0 +1,17 @@
+#pragma once
+
+/*
+
+A process-wide cache of images resampled to the exact pixel size they are drawn at
+
+Drawing an image at its own size is a plain blit, so the antialiased frames look up the sprite at
+the size of the destination rect once instead of smoothly resampling the full resolution asset on
+every draw. Entries are keyed by QImage::cacheKey(), which changes whenever an image is modified,
+and the least recently used ones are dropped once the cache holds more than a fixed number of bytes
+
+*/
+
+#include <QtGui/QImage>
+#include <memory>
+
+std::shared_ptr<QImage> get_scaled_sprite(const QImage &image, int w, int h);
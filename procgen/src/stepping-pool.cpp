@@ -0,0 +1,83 @@
+#include "stepping-pool.h"
+#include "vecgame.h"
+
+#include <algorithm>
+
+static int default_num_threads() {
+    int num_threads = (int)(std::thread::hardware_concurrency());
+    if (num_threads <= 0) {
+        num_threads = 4;
+    }
+    return num_threads;
+}
+
+SteppingPool *SteppingPool::get() {
+    // destroyed at exit, after python has closed its environments
+    static SteppingPool pool(default_num_threads());
+    return &pool;
+}
+
+SteppingPool::SteppingPool(int num_threads) {
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back(&SteppingPool::worker, this);
+    }
+}
+
+SteppingPool::~SteppingPool() {
+    {
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        time_to_die = true;
+    }
+    work_added.notify_all();
+
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+int SteppingPool::num_threads() const {
+    return (int)(threads.size());
+}
+
+void SteppingPool::submit(VecGame *venv) {
+    {
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        // the instance may still be in the ring from its previous batch
+        if (std::find(ring.begin(), ring.end(), venv) == ring.end()) {
+            ring.push_back(venv);
+        }
+    }
+    work_added.notify_all();
+}
+
+void SteppingPool::remove(VecGame *venv) {
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    ring.erase(std::remove(ring.begin(), ring.end(), venv), ring.end());
+}
+
+void SteppingPool::worker() {
+    while (1) {
+        VecGame *venv = nullptr;
+        int begin, end;
+
+        {
+            std::unique_lock<std::mutex> lock(pool_mutex);
+            while (venv == nullptr) {
+                work_added.wait(lock, [&] { return time_to_die || !ring.empty(); });
+                if (time_to_die) {
+                    return;
+                }
+                VecGame *front = ring.front();
+                ring.pop_front();
+                // claims happen under the pool lock so that remove() can't race with them
+                if (front->take_env_range(0, 0, &begin, &end)) {
+                    ring.push_back(front);
+                    venv = front;
+                }
+            }
+        }
+
+        venv->step_env_range(begin, end);
+        venv->finish_games(end - begin);
+    }
+}
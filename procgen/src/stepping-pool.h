@@ -0,0 +1,45 @@
+#pragma once
+
+/*
+
+A process-wide pool of stepping threads shared by every VecGame created with the shared_pool option
+
+Instances with a batch in flight sit in a ring, each worker takes the instance at the front,
+claims one chunk of its games and puts it at the back before stepping the chunk, so instances
+take turns one chunk at a time no matter how many games each of them has
+
+*/
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <vector>
+
+class VecGame;
+
+class SteppingPool {
+  public:
+    // the pool is created the first time this is called and lives until the process exits, when its
+    // workers finish the chunk they are stepping and are joined
+    static SteppingPool *get();
+
+    int num_threads() const;
+
+    // make the current batch of an instance available to the workers
+    void submit(VecGame *venv);
+    // stop handing out work from an instance, its current batch must have completed
+    void remove(VecGame *venv);
+
+  private:
+    SteppingPool(int num_threads);
+    ~SteppingPool();
+
+    std::mutex pool_mutex;
+    std::condition_variable work_added;
+    std::deque<VecGame *> ring;
+    std::vector<std::thread> threads;
+    bool time_to_die = false;
+
+    void worker();
+};
@@ -2,6 +2,16 @@
 #include "cpp-utils.h"
 #include "vecoptions.h"
 #include "game.h"
+#include "stepping-pool.h"
+#include "asset-pack.h"
+#include "background-cache.h"
+#include "alloc-counter.h"
+#include <limits>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 const int32_t END_OF_BUFFER = 0xCAFECAFE;
 
@@ -24,6 +34,40 @@ std::vector<std::string> split(std::string s, std::string delimiter) {
     return env_names;
 }
 
+// parse a list of cpus such as "0-7,16,18-19"
+std::vector<int> parse_cpu_list(std::string s) {
+    std::vector<int> cpus;
+
+    if (s == "") {
+        return cpus;
+    }
+
+    for (const auto &item : split(s, ",")) {
+        auto bounds = split(item, "-");
+        fassert(bounds.size() == 1 || bounds.size() == 2);
+        int low = std::stoi(bounds[0]);
+        int high = std::stoi(bounds.back());
+        fassert(0 <= low && low <= high);
+        for (int cpu = low; cpu <= high; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+static void pin_current_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (result != 0) {
+        fatal("failed to pin stepping thread to cpu %d\n", cpu);
+    }
+#endif
+}
+
 // libenv api
 
 // convert_bufs reorganizes buffers so that they are indexed by the environment
@@ -100,10 +144,19 @@ void libenv_close(libenv_env *handle) {
 
 // end libenv api
 
-static void stepping_worker(std::mutex &stepping_thread_mutex,
-                            std::list<std::shared_ptr<Game>> &pending_games,
-                            std::condition_variable &pending_games_added,
-                            std::condition_variable &pending_game_complete, bool &time_to_die) {
+static void step_game(Game *game) {
+    // the first time the threads are activated is before any step, just to initialize
+    // the environment and produce the initial observation
+    if (!game->initial_reset_complete) {
+        game->reset();
+        game->observe();
+        game->initial_reset_complete = true;
+    } else {
+        game->step();
+    }
+}
+
+void VecGame::queue_worker() {
     while (1) {
         std::shared_ptr<Game> game;
 
@@ -123,26 +176,223 @@ static void stepping_worker(std::mutex &stepping_thread_mutex,
             }
         }
 
-        // the first time the threads are activated is before any step, just to initialize
-        // the environment and produce the initial observation
-        if (!game->initial_reset_complete) {
-            game->reset();
-            game->observe();
-            game->initial_reset_complete = true;
-        } else{
-            game->step();
-        }
+        step_env(game.get());
 
         {
             std::unique_lock<std::mutex> lock(stepping_thread_mutex);
             game->is_waiting_for_step = false;
+            game->is_ready = true;
+            if (tracking_ready) {
+                ready_envs.push_back(game->game_n);
+            }
             pending_game_complete.notify_all();
         }
     }
 }
 
-void global_init(int rand_seed, std::string resource_root) {
+// work stealing ranges pack the dispatch generation and a [begin, end) range of env indices into
+// a single word so that the owning thread and stealing threads can claim indices with one compare and swap,
+// the generation keeps a thread that is late to notice a new batch from touching the ranges of that batch
+const int RANGE_INDEX_BITS = 24;
+const uint64_t RANGE_INDEX_MASK = (1ull << RANGE_INDEX_BITS) - 1;
+const uint64_t RANGE_GENERATION_MASK = 0xffff;
+
+static inline uint64_t pack_range(uint64_t generation, uint64_t begin, uint64_t end) {
+    return (generation << (2 * RANGE_INDEX_BITS)) | (begin << RANGE_INDEX_BITS) | end;
+}
+
+static inline uint64_t range_generation(uint64_t r) {
+    return r >> (2 * RANGE_INDEX_BITS);
+}
+
+static inline uint64_t range_begin(uint64_t r) {
+    return (r >> RANGE_INDEX_BITS) & RANGE_INDEX_MASK;
+}
+
+static inline uint64_t range_end(uint64_t r) {
+    return r & RANGE_INDEX_MASK;
+}
+
+bool VecGame::take_env_index(int thread_idx, uint32_t generation, int *env_idx) {
+    uint64_t gen = generation & RANGE_GENERATION_MASK;
+    auto &own = steal_ranges[thread_idx].packed;
+
+    uint64_t r = own.load(std::memory_order_acquire);
+    while (range_generation(r) == gen && range_begin(r) < range_end(r)) {
+        if (own.compare_exchange_weak(r, pack_range(gen, range_begin(r) + 1, range_end(r)), std::memory_order_acq_rel, std::memory_order_acquire)) {
+            *env_idx = (int)(range_begin(r));
+            return true;
+        }
+    }
+
+    // our own range is empty, steal the back half of the first non-empty range we find
+    int num_threads = (int)(steal_ranges.size());
+    for (int k = 1; k < num_threads; k++) {
+        auto &victim = steal_ranges[(thread_idx + k) % num_threads].packed;
+        uint64_t v = victim.load(std::memory_order_acquire);
+        while (range_generation(v) == gen && range_begin(v) < range_end(v)) {
+            uint64_t begin = range_begin(v);
+            uint64_t end = range_end(v);
+            uint64_t mid = begin + (end - begin) / 2;
+            if (victim.compare_exchange_weak(v, pack_range(gen, begin, mid), std::memory_order_acq_rel, std::memory_order_acquire)) {
+                // keep the first stolen index and publish the rest as our own range so it can be stolen in turn,
+                // no other thread writes our range while it is empty and the batch is incomplete
+                own.store(pack_range(gen, mid + 1, end), std::memory_order_release);
+                *env_idx = (int)(mid);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool VecGame::take_env_range(int thread_idx, uint32_t generation, int *begin, int *end) {
+    if (stepping_mode == ChunkedStepping) {
+        // a thread that is late to notice a new batch may claim a chunk of that batch here, which is
+        // harmless since the batch has already been fully set up by the time next_chunk is reset
+        int chunk = next_chunk.fetch_add(1, std::memory_order_acquire);
+        if (chunk >= num_chunks) {
+            return false;
+        }
+        *begin = chunk * chunk_size;
+        *end = std::min(*begin + chunk_size, num_envs);
+        return true;
+    }
+
+    if (!take_env_index(thread_idx, generation, begin)) {
+        return false;
+    }
+    *end = *begin + 1;
+    return true;
+}
+
+void VecGame::batch_worker(int thread_idx) {
+    uint32_t seen_generation = 0;
+
+    while (1) {
+        {
+            std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+            batch_dispatched.wait(lock, [&] { return time_to_die || dispatch_generation != seen_generation; });
+            if (time_to_die) {
+                return;
+            }
+            seen_generation = dispatch_generation;
+        }
+
+        int completed = 0;
+        int begin, end;
+        while (take_env_range(thread_idx, seen_generation, &begin, &end)) {
+            step_env_range(begin, end);
+            completed += end - begin;
+        }
+
+        // only the thread that completes the last game of the batch wakes up the python thread
+        if (completed > 0 && remaining_games.fetch_sub(completed, std::memory_order_acq_rel) == completed) {
+            std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+            batch_complete.notify_all();
+        }
+    }
+}
+
+void VecGame::step_env(Game *game) {
+    step_game(game);
+    if (render_human) {
+        // render the hi-res frame here so that it happens in parallel across the stepping threads
+        render_human_frame(game->game_n);
+    }
+}
+
+void VecGame::step_env_range(int begin, int end) {
+    for (int e = begin; e < end; e++) {
+        Game *game = games[e].get();
+        step_env(game);
+        game->is_waiting_for_step = false;
+    }
+}
+
+void VecGame::finish_games(int count) {
+    // used by the shared pool, holding the lock while counting down keeps the destructor from
+    // seeing the batch complete and freeing this instance before we are done with it
+    std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+    if (remaining_games.fetch_sub(count, std::memory_order_acq_rel) == count) {
+        batch_complete.notify_all();
+    }
+}
+
+bool VecGame::has_stepping_threads() const {
+    return threads.size() > 0 || pool != nullptr;
+}
+
+void VecGame::stepping_thread(int thread_idx, int cpu, const std::function<void(int)> *init_game) {
+    if (cpu >= 0) {
+        pin_current_thread(cpu);
+    }
+
+    if (init_game != nullptr) {
+        int begin, end;
+        home_range(thread_idx, &begin, &end);
+        for (int e = begin; e < end; e++) {
+            (*init_game)(e);
+        }
+        if (end > begin && remaining_games.fetch_sub(end - begin, std::memory_order_acq_rel) == end - begin) {
+            std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+            batch_complete.notify_all();
+        }
+    }
+
+    if (stepping_mode == QueueStepping) {
+        queue_worker();
+    } else {
+        batch_worker(thread_idx);
+    }
+}
+
+void VecGame::home_range(int thread_idx, int *begin, int *end) {
+    int num_threads = (int)(threads.size());
+    *begin = (int)((int64_t)(num_envs) * thread_idx / num_threads);
+    *end = (int)((int64_t)(num_envs) * (thread_idx + 1) / num_threads);
+}
+
+void VecGame::dispatch_games() {
+    if (!has_stepping_threads()) {
+        return;
+    }
+
+    uint32_t generation = dispatch_generation + 1;
+    remaining_games.store(num_envs, std::memory_order_relaxed);
+
+    if (stepping_mode == ChunkedStepping) {
+        next_chunk.store(0, std::memory_order_release);
+    } else {
+        // every thread starts from the same contiguous range of games each step
+        int num_threads = (int)(steal_ranges.size());
+        for (int t = 0; t < num_threads; t++) {
+            int begin, end;
+            home_range(t, &begin, &end);
+            steal_ranges[t].packed.store(pack_range(generation & RANGE_GENERATION_MASK, begin, end), std::memory_order_release);
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+        dispatch_generation = generation;
+    }
+
+    if (pool != nullptr) {
+        pool->submit(this);
+    } else {
+        batch_dispatched.notify_all();
+    }
+}
+
+void global_init(int rand_seed, std::string resource_root, std::string asset_pack, bool shared_assets, int background_cache_mb) {
     global_resource_root = resource_root;
+    global_asset_pack_path = shared_assets ? shared_asset_pack_path(resource_root) : asset_pack;
+    if (shared_assets) {
+        use_shared_asset_pack(global_asset_pack_path);
+    }
+    set_background_cache_limit((size_t)(background_cache_mb) * 1024 * 1024);
 
     try {
         images_load();
@@ -168,6 +418,11 @@ inline uint32_t hash_str_uint32(const std::string &str) {
 
 VecGame::VecGame(int _nenvs, VecOptions opts) {
     render_human = false;
+    bool episode_stats = false;
+    double_buffered = false;
+    shared_pool = false;
+    buffer_set = 0;
+    stepping_buffer_set = 0;
     num_envs = _nenvs;
     games.resize(num_envs);
     std::string env_name;
@@ -178,7 +433,12 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
 
     int rand_seed = 0;
     int num_threads = 4;
+    int stepping_mode_int = QueueStepping;
     std::string resource_root;
+    std::string asset_pack;
+    bool shared_assets = false;
+    int background_cache_mb = 64;
+    std::string cpu_list;
 
     opts.consume_string("env_name", &env_name);
     opts.consume_int("num_levels", &num_levels);
@@ -186,24 +446,63 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
     opts.consume_int("num_actions", &num_actions);
     opts.consume_int("rand_seed", &rand_seed);
     opts.consume_int("num_threads", &num_threads);
+    opts.consume_int("stepping_mode", &stepping_mode_int);
+    opts.consume_int("chunk_size", &chunk_size);
     opts.consume_string("resource_root", &resource_root);
+    opts.consume_string("asset_pack", &asset_pack);
+    opts.consume_bool("shared_assets", &shared_assets);
+    opts.consume_int("background_cache_mb", &background_cache_mb);
     opts.consume_bool("render_human", &render_human);
+    opts.consume_bool("episode_stats", &episode_stats);
+    opts.consume_bool("double_buffered", &double_buffered);
+    opts.consume_string("cpu_list", &cpu_list);
+    opts.consume_bool("shared_pool", &shared_pool);
+
+    if (shared_assets && asset_pack != "") {
+        fatal("asset_pack and shared_assets can't be used together\n");
+    }
+    fassert(background_cache_mb >= 0);
 
     std::call_once(global_init_flag, global_init, rand_seed,
-                   resource_root);
+                   resource_root, asset_pack, shared_assets, background_cache_mb);
 
     fassert(num_threads >= 0);
-    threads.resize(num_threads);
-    for (int t = 0; t < num_threads; t++) {
-        threads[t] = std::thread(
-            stepping_worker,
-            std::ref(stepping_thread_mutex),
-            std::ref(pending_games),
-            std::ref(pending_games_added),
-            std::ref(pending_game_complete),
-            std::ref(time_to_die));
+    stepping_mode = static_cast<SteppingMode>(stepping_mode_int);
+
+    if (shared_pool) {
+        // the pool hands out chunks, so the queue mode is replaced by the chunked mode
+        if (stepping_mode == WorkStealingStepping) {
+            fatal("shared_pool does not support the work_stealing stepping mode\n");
+        }
+        if (cpu_list != "") {
+            fatal("shared_pool does not support cpu_list\n");
+        }
+        pool = SteppingPool::get();
+        stepping_mode = ChunkedStepping;
     }
 
+    if (stepping_mode == WorkStealingStepping) {
+        fassert((uint64_t)(num_envs) <= RANGE_INDEX_MASK);
+        steal_ranges = std::vector<StealRange>(num_threads);
+    } else if (stepping_mode == ChunkedStepping) {
+        fassert(chunk_size >= 0);
+        if (chunk_size == 0) {
+            // default to roughly four chunks per thread so that uneven games still balance out
+            int chunk_threads = pool != nullptr ? pool->num_threads() : num_threads;
+            chunk_size = std::max(1, num_envs / std::max(1, 4 * chunk_threads));
+        }
+        num_chunks = (num_envs + chunk_size - 1) / chunk_size;
+    } else if (stepping_mode != QueueStepping) {
+        fatal("invalid stepping_mode %d\n", stepping_mode);
+    }
+
+    std::vector<int> cpus = parse_cpu_list(cpu_list);
+#ifndef __linux__
+    if (cpus.size() > 0) {
+        fatal("cpu_list is only supported on linux\n");
+    }
+#endif
+
     fassert(env_name != "");
     fassert(num_actions > 0);
     fassert(num_levels >= 0);
@@ -281,6 +580,26 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
         info_types.push_back(s);
     }
 
+    if (episode_stats) {
+        struct libenv_tensortype s;
+        strcpy(s.name, "episode_return");
+        s.scalar_type = LIBENV_SCALAR_TYPE_REAL;
+        s.dtype = LIBENV_DTYPE_FLOAT32;
+        s.ndim = 0,
+        s.low.float32 = std::numeric_limits<float>::lowest();
+        s.high.float32 = std::numeric_limits<float>::max();
+        info_types.push_back(s);
+
+        for (const char *name : {"episode_length", "episodes_completed", "levels_solved"}) {
+            strcpy(s.name, name);
+            s.scalar_type = LIBENV_SCALAR_TYPE_DISCRETE;
+            s.dtype = LIBENV_DTYPE_INT32;
+            s.low.int32 = 0;
+            s.high.int32 = INT32_MAX;
+            info_types.push_back(s);
+        }
+    }
+
     int level_seed_low = 0;
     int level_seed_high = 0;
 
@@ -301,23 +620,32 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
     RandGen game_level_seed_gen;
     game_level_seed_gen.seed(rand_seed);
 
-    std::map<std::string, int> info_name_to_offset;
-    for (size_t i = 0; i < info_types.size(); i++) {
-        info_name_to_offset[info_types[i].name] = i;
+    for (int slot = 0; slot < NUM_INFO_SLOTS; slot++) {
+        info_slot_offsets[slot] = -1;
+        for (size_t i = 0; i < info_types.size(); i++) {
+            if (strcmp(info_types[i].name, INFO_SLOT_NAMES[slot]) == 0) {
+                info_slot_offsets[slot] = (int)(i);
+            }
+        }
     }
 
+    // draw the level seeds up front so they don't depend on which thread creates each game
+    std::vector<int> level_seed_seeds(num_envs);
     for (int n = 0; n < num_envs; n++) {
+        level_seed_seeds[n] = game_level_seed_gen.randint();
+    }
+
+    std::function<void(int)> init_game = [&](int n) {
         auto name = env_names[n % num_joint_games];
 
         games[n] = globalGameRegistry->at(name)();
         fassert(games[n]->game_name == name);
-        games[n]->level_seed_rand_gen.seed(game_level_seed_gen.randint());
+        games[n]->level_seed_rand_gen.seed(level_seed_seeds[n]);
         games[n]->level_seed_high = level_seed_high;
         games[n]->level_seed_low = level_seed_low;
         games[n]->game_n = n;
         games[n]->is_waiting_for_step = false;
         games[n]->parse_options(name, opts);
-        games[n]->info_name_to_offset = info_name_to_offset;
 
         // Auto-selected a fixed_asset_seed if one wasn't specified on
         // construction
@@ -327,52 +655,192 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
         }
 
         games[n]->game_init();
+    };
+
+    // with pinned work stealing threads, each game is created by the thread whose range it starts in,
+    // so that its memory is allocated and first touched on that thread's NUMA node
+    bool init_on_threads = stepping_mode == WorkStealingStepping && cpus.size() > 0 && num_threads > 0;
+
+    if (!init_on_threads) {
+        for (int n = 0; n < num_envs; n++) {
+            init_game(n);
+        }
     }
+
+    if (pool != nullptr) {
+        // the pool's threads step our games
+        num_threads = 0;
+    }
+
+    remaining_games.store(init_on_threads ? num_envs : 0);
+    threads.resize(num_threads);
+    for (int t = 0; t < num_threads; t++) {
+        int cpu = cpus.size() > 0 ? cpus[t % cpus.size()] : -1;
+        threads[t] = std::thread(&VecGame::stepping_thread, this, t, cpu, init_on_threads ? &init_game : nullptr);
+    }
+
+    if (init_on_threads) {
+        // init_game refers to locals of this constructor, so wait for the threads to finish creating their games
+        wait_for_stepping_threads();
+    }
+}
+
+void VecGame::use_buffer_set(int env_idx, int set_idx) {
+    const auto &game = games[env_idx];
+    const auto &bufs = buffer_sets[set_idx];
+    // we only ever have one action
+    game->action_ptr = (int32_t *)(bufs.ac[env_idx][0]);
+    game->obs_bufs = bufs.ob[env_idx];
+    for (int slot = 0; slot < NUM_INFO_SLOTS; slot++) {
+        int offset = info_slot_offsets[slot];
+        game->info_slots[slot] = offset >= 0 ? bufs.info[env_idx][offset] : nullptr;
+    }
+    game->reward_ptr = &bufs.rew[env_idx];
+    game->first_ptr = &bufs.first[env_idx];
 }
 
 void VecGame::set_buffers(const std::vector<std::vector<void *>> &ac, const std::vector<std::vector<void *>> &ob, const std::vector<std::vector<void *>> &info, float *rew, uint8_t *first) {
+    fassert((int)(buffer_sets.size()) < (double_buffered ? 2 : 1));
+    buffer_sets.push_back(BufferSet{ac, ob, info, rew, first});
+
+    if (buffer_sets.size() == 2) {
+        // the second buffer set only receives observations once act() is called
+        return;
+    }
+
     {
         std::unique_lock<std::mutex> lock(stepping_thread_mutex);
 
         for (int e = 0; e < num_envs; e++) {
             const auto &game = games[e];
-            // we only ever have one action
-            game->action_ptr = (int32_t *)(ac[e][0]);
-            game->obs_bufs = ob[e];
-            game->info_bufs = info[e];
-            game->reward_ptr = &rew[e];
-            game->first_ptr = &first[e];
-            
+            use_buffer_set(e, buffer_set);
+
             // render the initial state so we don't see a black screen on the first frame
             fassert(!game->is_waiting_for_step);
             fassert(!game->initial_reset_complete);
-            if (threads.size() == 0) {
+            if (!has_stepping_threads()) {
                 // special case for no threads
                 game->reset();
                 game->observe();
                 game->initial_reset_complete = true;
+                game->is_ready = true;
+                if (tracking_ready) {
+                    ready_envs.push_back(e);
+                }
             } else {
                 game->is_waiting_for_step = true;
-                pending_games.push_back(game);
+                if (stepping_mode == QueueStepping) {
+                    pending_games.push_back(game);
+                }
             }
         }
     }
-    pending_games_added.notify_all();
+
+    if (stepping_mode == QueueStepping) {
+        pending_games_added.notify_all();
+    } else {
+        dispatch_games();
+    }
 }
 
 void VecGame::observe() {
     wait_for_stepping_threads();
     // at this point all games belong to the python thread
+    buffer_set = stepping_buffer_set;
 
-    if (render_human) {
-        uint8_t render_hires_buf[RENDER_RES * RENDER_RES * 4];
+    if (render_human && !has_stepping_threads()) {
+        // without stepping threads the hi-res frames are rendered here instead
+        for (int e = 0; e < num_envs; e++) {
+            render_human_frame(e);
+        }
+    }
+}
+
+void VecGame::render_human_frame(int env_idx) {
+    // too big for the stack, and each thread renders one frame at a time
+    static thread_local std::vector<uint32_t> render_hires_buf(RENDER_RES * RENDER_RES);
+
+    const auto &game = games[env_idx];
+    game->render_to_buf(render_hires_buf.data(), RENDER_RES, RENDER_RES, true);
+    bgr32_to_rgb888(game->info_ptr(RENDER_RGB_INFO), render_hires_buf.data(), RENDER_RES, RENDER_RES);
+}
 
+void VecGame::start_tracking_ready() {
+    if (stepping_mode != QueueStepping) {
+        fatal("recv_ready and send_ready are only supported with stepping_mode=queue\n");
+    }
+    fassert(!double_buffered);
+
+    std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+    if (!tracking_ready) {
+        // games that finished before now are handed out in index order
+        tracking_ready = true;
         for (int e = 0; e < num_envs; e++) {
+            if (games[e]->is_ready) {
+                ready_envs.push_back(e);
+            }
+        }
+    }
+}
+
+void VecGame::recv_ready(int count, int32_t *env_idxs) {
+    start_tracking_ready();
+    fassert(0 <= count && count <= num_envs);
+
+    {
+        std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+
+        // make sure enough games are ready or in flight, otherwise we would wait forever
+        int available = (int)(ready_envs.size());
+        for (const auto &game : games) {
+            available += game->is_waiting_for_step;
+        }
+        fassert(count <= available);
+
+        pending_game_complete.wait(lock, [&] { return (int)(ready_envs.size()) >= count; });
+
+        for (int i = 0; i < count; i++) {
+            int e = ready_envs.front();
+            ready_envs.pop_front();
+            games[e]->is_ready = false;
+            env_idxs[i] = e;
+        }
+    }
+    // at this point the returned games belong to the python thread
+
+    if (render_human && !has_stepping_threads()) {
+        for (int i = 0; i < count; i++) {
+            render_human_frame(env_idxs[i]);
+        }
+    }
+}
+
+void VecGame::send_ready(int count, const int32_t *env_idxs) {
+    start_tracking_ready();
+
+    {
+        std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+
+        for (int i = 0; i < count; i++) {
+            int e = env_idxs[i];
+            fassert(0 <= e && e < num_envs);
             const auto &game = games[e];
-            game->render_to_buf(render_hires_buf, RENDER_RES, RENDER_RES, true);
-            bgr32_to_rgb888(game->info_bufs[game->info_name_to_offset.at("rgb")], render_hires_buf, RENDER_RES, RENDER_RES);
+            // the game must have been handed back by recv_ready() before it can be stepped again
+            fassert(!game->is_waiting_for_step && !game->is_ready);
+            game->action = *game->action_ptr;
+            if (!has_stepping_threads()) {
+                // special case for no threads
+                game->step();
+                game->is_ready = true;
+                ready_envs.push_back(e);
+            } else {
+                game->is_waiting_for_step = true;
+                pending_games.push_back(game);
+            }
         }
     }
+
+    pending_games_added.notify_all();
 }
 
 void VecGame::act() {
@@ -381,23 +849,48 @@ void VecGame::act() {
     {
         std::unique_lock<std::mutex> lock(stepping_thread_mutex);
 
+        // a full step hands every game back, so drop any that recv_ready() has not returned yet
+        ready_envs.clear();
+
+        if (double_buffered) {
+            fassert(buffer_sets.size() == 2);
+            // the last step has completed even if observe() was not called after it
+            buffer_set = stepping_buffer_set;
+            stepping_buffer_set = 1 - buffer_set;
+        }
+
         for (int e = 0; e < num_envs; e++) {
             const auto &game = games[e];
             fassert(!game->is_waiting_for_step);
+            game->is_ready = false;
             // save the action since it's only valid for the duration of this call
             game->action = *game->action_ptr;
-            if (threads.size() == 0) {
+            if (double_buffered) {
+                // the action came from the set holding the newest observation, write the next one to the other set
+                use_buffer_set(e, stepping_buffer_set);
+            }
+            if (!has_stepping_threads()) {
                 // special case for no threads
                 game->step();
+                game->is_ready = true;
+                if (tracking_ready) {
+                    ready_envs.push_back(e);
+                }
             } else {
                 game->is_waiting_for_step = true;
-                pending_games.push_back(game);
+                if (stepping_mode == QueueStepping) {
+                    pending_games.push_back(game);
+                }
             }
         }
     }
     // at this point all games belong to the stepping threads
 
-    pending_games_added.notify_all();
+    if (stepping_mode == QueueStepping) {
+        pending_games_added.notify_all();
+    } else {
+        dispatch_games();
+    }
 }
 
 VecGame::~VecGame() {
@@ -407,18 +900,29 @@ VecGame::~VecGame() {
         time_to_die = true;
     }
     pending_games_added.notify_all();
+    batch_dispatched.notify_all();
 
     for (auto &t : threads) {
         t.join();
     }
+
+    if (pool != nullptr) {
+        pool->remove(this);
+    }
 }
 
 void VecGame::wait_for_stepping_threads() {
-    if (threads.size() == 0) {
+    if (!has_stepping_threads()) {
         return;
     }
 
     std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+
+    if (stepping_mode != QueueStepping) {
+        batch_complete.wait(lock, [&] { return remaining_games.load(std::memory_order_acquire) == 0; });
+        return;
+    }
+
     while (1) {
         bool all_steps_completed = true;
 
@@ -444,6 +948,37 @@ extern "C" {
         return b.offset;
     }
 
+    LIBENV_API int64_t get_entity_allocations(libenv_env *handle, int env_idx) {
+        auto venv = (VecGame *)(handle);
+        venv->wait_for_stepping_threads();
+        return venv->games.at(env_idx)->get_entity_allocations();
+    }
+
+    LIBENV_API int64_t get_step_allocations(libenv_env *handle, int env_idx) {
+        auto venv = (VecGame *)(handle);
+        venv->wait_for_stepping_threads();
+        if (!counting_allocations()) {
+            return -1;
+        }
+        return venv->games.at(env_idx)->step_allocations;
+    }
+
+    LIBENV_API void recv_ready(libenv_env *handle, int count, int32_t *env_idxs) {
+        auto venv = (VecGame *)(handle);
+        venv->recv_ready(count, env_idxs);
+    }
+
+    LIBENV_API void send_ready(libenv_env *handle, int count, int32_t *env_idxs) {
+        auto venv = (VecGame *)(handle);
+        venv->send_ready(count, env_idxs);
+    }
+
+    LIBENV_API int get_buffer_set(libenv_env *handle) {
+        // index of the buffer set that holds the observation from the last libenv_observe()
+        auto venv = (VecGame *)(handle);
+        return venv->buffer_set;
+    }
+
     LIBENV_API void set_state(libenv_env *handle, int env_idx, char *data, int length) {
         auto venv = (VecGame *)(handle);
         venv->wait_for_stepping_threads();
@@ -453,5 +988,8 @@ extern "C" {
         // after deserializing, we need to update the observation and info buffers so that the
         // next time VecGame::observe() is called, the correct data will be in the buffers
         venv->games.at(env_idx)->observe();
+        if (venv->render_human) {
+            venv->render_human_frame(env_idx);
+        }
     }
 }
\ No newline at end of file
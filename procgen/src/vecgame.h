@@ -13,9 +13,35 @@ This implements the libenv interface and manages a vector of Game instances
 #include <condition_variable>
 #include <thread>
 #include <list>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include "info-slots.h"
 
 class VecOptions;
 class Game;
+class SteppingPool;
+
+// how games are handed to the stepping threads, should match STEPPING_MODE_DICT in env.py
+enum SteppingMode {
+    QueueStepping = 0,
+    WorkStealingStepping = 1,
+    ChunkedStepping = 2,
+};
+
+// buffers registered by one call to libenv_set_buffers, indexed by env
+struct BufferSet {
+    std::vector<std::vector<void *>> ac;
+    std::vector<std::vector<void *>> ob;
+    std::vector<std::vector<void *>> info;
+    float *rew = nullptr;
+    uint8_t *first = nullptr;
+};
+
+// a [begin, end) range of env indices owned by one stepping thread, padded to avoid false sharing
+struct alignas(64) StealRange {
+    std::atomic<uint64_t> packed{0};
+};
 
 class VecGame {
   public:
@@ -27,6 +53,20 @@ class VecGame {
     int num_joint_games;
     int num_actions;
     bool render_human;
+    SteppingMode stepping_mode;
+    // step the games on the process-wide SteppingPool instead of threads owned by this instance
+    bool shared_pool;
+
+    // with double_buffered set, libenv_set_buffers is called twice to register two buffer sets,
+    // each act() reads actions from the set holding the newest observation and the games write
+    // the next observation into the other set, so the caller can keep reading the set returned
+    // by the last observe() while the games step
+    bool double_buffered;
+    // the set holding the newest observation the caller has waited for, only updated once the games
+    // have finished writing to it
+    int buffer_set;
+    // the set the games are writing to
+    int stepping_buffer_set;
 
     std::vector<std::shared_ptr<Game>> games;
 
@@ -38,7 +78,24 @@ class VecGame {
     void act();
     void wait_for_stepping_threads();
 
+    // partial batch stepping, recv_ready() waits for the first count games to finish stepping and
+    // send_ready() steps just the given games, only supported by the queue stepping mode
+    void recv_ready(int count, int32_t *env_idxs);
+    void send_ready(int count, const int32_t *env_idxs);
+
+    // render the hi-res frame of a game into its "rgb" info buffer
+    void render_human_frame(int env_idx);
+
   private:
+    friend class SteppingPool;
+
+    std::vector<BufferSet> buffer_sets;
+
+    void use_buffer_set(int env_idx, int set_idx);
+    void start_tracking_ready();
+    // offset of each info slot in the info buffers, -1 for slots that are not enabled
+    int info_slot_offsets[NUM_INFO_SLOTS];
+
     // this mutex synchronizes access to pending_games and game->is_waiting_for_step
     // when game->is_waiting_for_step is set to true
     // ownership of game objects is transferred to the stepping thread until
@@ -47,6 +104,39 @@ class VecGame {
     std::list<std::shared_ptr<Game>> pending_games;
     std::condition_variable pending_games_added;
     std::condition_variable pending_game_complete;
+    // env indices in the order their games finished stepping, cleared by act(), only kept from the
+    // first call to recv_ready() or send_ready() on so that full batches don't pay for it
+    std::deque<int> ready_envs;
+    bool tracking_ready = false;
     std::vector<std::thread> threads;
     bool time_to_die = false;
+
+    // batch modes hand out all games at once and count down remaining_games as they complete
+    std::atomic<int> remaining_games{0};
+    uint32_t dispatch_generation = 0;
+    std::condition_variable batch_dispatched;
+    std::condition_variable batch_complete;
+
+    // work stealing mode, each thread steps the env indices in its own range and steals
+    // half of another thread's remaining range once its own is empty
+    std::vector<StealRange> steal_ranges;
+
+    // chunked mode, threads claim contiguous chunks of chunk_size games at a time
+    int chunk_size = 0;
+    int num_chunks = 0;
+    alignas(64) std::atomic<int> next_chunk{0};
+
+    SteppingPool *pool = nullptr;
+
+    bool has_stepping_threads() const;
+    void stepping_thread(int thread_idx, int cpu, const std::function<void(int)> *init_game);
+    void home_range(int thread_idx, int *begin, int *end);
+    void dispatch_games();
+    void queue_worker();
+    void batch_worker(int thread_idx);
+    void step_env(Game *game);
+    void step_env_range(int begin, int end);
+    void finish_games(int count);
+    bool take_env_range(int thread_idx, uint32_t generation, int *begin, int *end);
+    bool take_env_index(int thread_idx, uint32_t generation, int *env_idx);
 };